@@ -1,4 +1,6 @@
 MICROBENCH_PATH=am-kernels/benchmarks/microbench
+# AM_ARCH=<arch> : microbench built for the abstract-machine <arch> (default minirv-npc)
+AM_ARCH="${AM_ARCH:-minirv-npc}"
 
 usage() {
   echo "Usage:"
@@ -21,5 +23,5 @@ case "$CPU" in
 esac
 
 cd $MICROBENCH_PATH
-make ARCH=minirv-npc run verbose=4 cpu="$CPU" mainargs=train
+make ARCH="$AM_ARCH" run verbose=4 cpu="$CPU" mainargs=train
 cd - >/dev/null
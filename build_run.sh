@@ -7,16 +7,60 @@ RTL_ROOT=/home/bekzat/chip_bootcamp
 DBG_CFLAGS="-g3 -O0 -fno-omit-frame-pointer"
 DBG_LDFLAGS="-g"
 
+# VCPU_MEM=dpi     : vcpu memory is dpi_mem.sv instead of the testbench bus agents
+# DPI_LATENCY=<n>  : dpi_mem response latency in cycles after the request cycle + 1 (default 0)
+# THREADS=<n>      : vsoc model with verilator --threads <n> (default 1)
+# VCPU_THREADS=<n> : vcpu model with verilator --threads <n> (default 1)
+# HIER=1           : vsoc model with the peripherals of soc/hier.vlt as hierarchical blocks
+# CPU_CORE=pipe    : vsoc/vcpu with the 5-stage pipelined core cpu_pipe.sv instead of the multicycle cpu.sv (default multi)
+# DCACHE=1         : vsoc/vcpu with the write-back data cache dcache.sv in the lsu
+# BUS_DEPTH=<n>    : vcpu ifu with up to <n> bus requests in flight, 1 to 8 (default 1)
+# IDLE_SKIP=1      : vcpu whose registers and counters the testbench may write, needed by 'idle-skip'
+# SIM_PROFILE=1    : testbench that times its phases (evals, gold, agents, ...), printed at exit with verbose 4
+# VCPU_TIMING=<m>  : adds 'timing <m>' to the testbench arguments, XIP_BURST=1 adds 'xip-burst' (for runs started by make)
+VCPU_MEM="${VCPU_MEM:-agent}"
+DPI_LATENCY="${DPI_LATENCY:-0}"
+THREADS="${THREADS:-1}"
+VCPU_THREADS="${VCPU_THREADS:-1}"
+HIER="${HIER:-0}"
+CPU_CORE="${CPU_CORE:-multi}"
+DCACHE="${DCACHE:-0}"
+BUS_DEPTH="${BUS_DEPTH:-1}"
+IDLE_SKIP="${IDLE_SKIP:-0}"
+SIM_PROFILE="${SIM_PROFILE:-0}"
+VCPU_TIMING="${VCPU_TIMING:-}"
+XIP_BURST="${XIP_BURST:-0}"
+# PGO_DIR=<path>   : profiles of the pgo-gen build, read by the pgo-use build (default pgo)
+PGO_DIR="${PGO_DIR:-$RTL_ROOT/pgo}"
+
 usage() {
   echo "Usage:"
   echo "  $0 slow [testbench_args...]  #    debug build + run"
   echo "  $0 fast [testbench_args...]  # no debug build + run"
+  echo "  $0 pgo-gen [testbench_args...]  # -O2 build that writes profiles to PGO_DIR + run"
+  echo "  $0 pgo-use [testbench_args...]  # -O2 LTO build with the profiles of PGO_DIR + run"
+  echo "  $0 lto [testbench_args...]      # -O2 LTO build without profiles + run, the pgo-use baseline"
+  echo "  VCPU_MEM=dpi DPI_LATENCY=<n> $0 ... # vcpu with dpi memory"
+  echo "  THREADS=<n> VCPU_THREADS=<n> HIER=1 $0 ... # multi-threaded vsoc/vcpu models"
+  echo "  CPU_CORE=pipe $0 ... # pipelined core"
+  echo "  DCACHE=1 $0 ... # data cache in the lsu"
+  echo "  BUS_DEPTH=<n> $0 ... # vcpu ifu requests in flight"
+  echo "  IDLE_SKIP=1 $0 ... idle-skip ... # vcpu idle loop skipping"
+  echo "  SIM_PROFILE=1 $0 ... verbose 4 # testbench time per phase"
+  echo "  VCPU_TIMING=soc XIP_BURST=1 $0 ... # vcpu timing model and flash continuous read"
 }
 
 MODE="${1:-slow}"
 shift || true
 TB_ARGS=("$@")
+if [[ -n "$VCPU_TIMING" ]]; then
+  TB_ARGS+=(timing "$VCPU_TIMING")
+fi
+if [[ "$XIP_BURST" == "1" ]]; then
+  TB_ARGS+=(xip-burst)
+fi
 
+PGO_BUILD=""
 case "$MODE" in
   slow)
     DEBUG_BUILD=1
@@ -24,23 +68,167 @@ case "$MODE" in
   fast)
     DEBUG_BUILD=0
     ;;
+  pgo-gen|pgo-use)
+    DEBUG_BUILD=0
+    PGO_BUILD="${MODE#pgo-}"
+    ;;
+  lto)
+    DEBUG_BUILD=0
+    PGO_BUILD="lto"
+    ;;
+  *)
+    usage
+    exit 1
+    ;;
+esac
+
+# NOTE: pgo-gen and pgo-use share the obj dirs and the binary, gcc finds the profiles by object path
+BUILD_NAME="${MODE}"
+if [[ "$PGO_BUILD" == "gen" || "$PGO_BUILD" == "use" ]]; then
+  BUILD_NAME="pgo"
+fi
+OBJ_CPU="obj_cpu_${BUILD_NAME}"
+OBJ_SOC="obj_soc_${BUILD_NAME}"
+TB_BIN="bin/testbench_${BUILD_NAME}"
+
+VCPU_TOP=(--top-module cpu)
+VCPU_SRCS=()
+TB_DEFINES=()
+SOC_OPTS=()
+if [[ "$THREADS" -gt 1 ]]; then
+  OBJ_SOC="${OBJ_SOC}_t${THREADS}"
+  TB_BIN="${TB_BIN}_t${THREADS}"
+  SOC_OPTS+=(--threads "$THREADS")
+fi
+if [[ "$HIER" -eq 1 ]]; then
+  OBJ_SOC="${OBJ_SOC}_hier"
+  TB_BIN="${TB_BIN}_hier"
+  SOC_OPTS+=(--hierarchical soc/hier.vlt)
+fi
+
+case "$VCPU_MEM" in
+  agent)
+    ;;
+  dpi)
+    OBJ_CPU="obj_cpu_dpi${DPI_LATENCY}_${BUILD_NAME}"
+    TB_BIN="${TB_BIN}_dpi${DPI_LATENCY}"
+    VCPU_TOP=(--top-module cpu_dpi --prefix Vcpu -GLATENCY="$DPI_LATENCY")
+    VCPU_SRCS=(soc/dpi_mem.sv soc/cpu_dpi.sv)
+    TB_DEFINES=(-DVCPU_DPI_MEM)
+    ;;
+  *)
+    usage
+    exit 1
+    ;;
+esac
+
+CORE_DEFINES=()
+case "$CPU_CORE" in
+  multi)
+    ;;
+  pipe)
+    OBJ_CPU="${OBJ_CPU}_pipe"
+    OBJ_SOC="${OBJ_SOC}_pipe"
+    TB_BIN="${TB_BIN}_pipe"
+    CORE_DEFINES=(+define+CPU_PIPE)
+    TB_DEFINES+=(-DCPU_PIPE)
+    ;;
   *)
     usage
     exit 1
     ;;
 esac
 
-OBJ_CPU="obj_cpu_${MODE}"
-OBJ_SOC="obj_soc_${MODE}"
-TB_BIN="bin/testbench_${MODE}"
+if [[ "$DCACHE" == "1" ]]; then
+  OBJ_CPU="${OBJ_CPU}_dc"
+  OBJ_SOC="${OBJ_SOC}_dc"
+  TB_BIN="${TB_BIN}_dc"
+  CORE_DEFINES+=(+define+DCACHE)
+  TB_DEFINES+=(-DDCACHE)
+  # NOTE: the testbench reads the lines by the geometry of the rtl, taken from its localparams
+  for PARAM in DCACHE_WAYS DCACHE_SETS DCACHE_LINE_WORDS; do
+    VALUE="$(sed -n "s/^localparam $PARAM *= *\([0-9]*\);.*/\1/p" "$RTL_ROOT/soc/dcache_defines.vh")"
+    if [[ -z "$VALUE" ]]; then
+      echo "[ERROR] $PARAM not found in soc/dcache_defines.vh"
+      exit 1
+    fi
+    TB_DEFINES+=(-D"$PARAM=$VALUE")
+  done
+fi
+
+# NOTE: only the vcpu, the vsoc bridge takes one request at a time and dpi_mem answers one request
+if [[ "$BUS_DEPTH" -gt 1 ]]; then
+  if [[ "$VCPU_MEM" != "agent" || "$BUS_DEPTH" -gt 8 ]]; then
+    usage
+    exit 1
+  fi
+  OBJ_CPU="${OBJ_CPU}_bd${BUS_DEPTH}"
+  TB_BIN="${TB_BIN}_bd${BUS_DEPTH}"
+  VCPU_TOP+=(-GBUS_DEPTH="$BUS_DEPTH")
+  TB_DEFINES+=(-DVCPU_BUS_DEPTH="$BUS_DEPTH")
+fi
+
+# NOTE: only the vcpu, public_flat_rw on the registers and counters slows the scheduling of any model
+if [[ "$IDLE_SKIP" == "1" ]]; then
+  OBJ_CPU="${OBJ_CPU}_is"
+  TB_BIN="${TB_BIN}_is"
+  VCPU_TOP+=(+define+IDLE_SKIP)
+  TB_DEFINES+=(-DIDLE_SKIP)
+fi
+
+if [[ "$SIM_PROFILE" == "1" ]]; then
+  TB_BIN="${TB_BIN}_prof"
+  TB_DEFINES+=(-DSIM_PROFILE)
+fi
+
+if [[ "$VCPU_THREADS" -gt 1 ]]; then
+  OBJ_CPU="${OBJ_CPU}_t${VCPU_THREADS}"
+  TB_BIN="${TB_BIN}_ct${VCPU_THREADS}"
+  VCPU_TOP+=(--threads "$VCPU_THREADS")
+fi
+
+# NOTE: the testbench refuses snapshot with a threaded model, fork copies only the calling thread
+if [[ "$THREADS" -gt 1 || "$VCPU_THREADS" -gt 1 ]]; then
+  TB_DEFINES+=(-DVTHREADS)
+fi
+
+TB_OPT=()
+MAKE_OPTS=()
+case "$PGO_BUILD" in
+  gen)
+    PGO_FLAGS="-O2 -fprofile-generate=$PGO_DIR -fprofile-update=atomic"
+    MAKE_OPTS=(OPT_FAST="$PGO_FLAGS" OPT_SLOW="$PGO_FLAGS" OPT_GLOBAL="$PGO_FLAGS")
+    TB_OPT=($PGO_FLAGS)
+    # NOTE: verilator thread scheduling profile, written to profile.vlt by the training run
+    if [[ "$THREADS" -gt 1 ]]; then
+      SOC_OPTS+=(--prof-pgo)
+    fi
+    ;;
+  use)
+    PGO_FLAGS="-O2 -flto=auto -fprofile-use=$PGO_DIR -fprofile-partial-training -Wno-missing-profile"
+    MAKE_OPTS=(OPT_FAST="$PGO_FLAGS" OPT_SLOW="$PGO_FLAGS" OPT_GLOBAL="$PGO_FLAGS" AR=gcc-ar)
+    TB_OPT=($PGO_FLAGS)
+    if [[ "$THREADS" -gt 1 && -f "$PGO_DIR/profile.vlt" ]]; then
+      SOC_OPTS+=("$PGO_DIR/profile.vlt")
+    fi
+    ;;
+  lto)
+    PGO_FLAGS="-O2 -flto=auto"
+    MAKE_OPTS=(OPT_FAST="$PGO_FLAGS" OPT_SLOW="$PGO_FLAGS" OPT_GLOBAL="$PGO_FLAGS" AR=gcc-ar)
+    TB_OPT=($PGO_FLAGS)
+    ;;
+esac
 
 cd "$RTL_ROOT"
 
 verilator --trace -cc \
   -Wall \
   -I"$RTL_ROOT/soc" \
-  soc/cpu.sv \
-  soc/rf.sv soc/pc.sv soc/exu.sv soc/idu.sv soc/alu.sv soc/csr.sv soc/com.sv soc/icache.sv \
+  soc/cpu.sv soc/cpu_pipe.sv \
+  soc/rf.sv soc/pc.sv soc/exu.sv soc/exu_pipe.sv soc/bpu.sv soc/idu.sv soc/decoder.sv soc/rvc.sv soc/ifu_align.sv soc/alu.sv soc/div.sv soc/csr.sv soc/com.sv soc/icache.sv soc/dcache.sv \
+  "${CORE_DEFINES[@]}" \
+  "${VCPU_SRCS[@]}" \
+  "${VCPU_TOP[@]}" \
   --timescale "1ns/1ns" \
   --no-timing \
   --Mdir "$OBJ_CPU"
@@ -56,6 +244,8 @@ verilator --trace -cc \
   --timescale "1ns/1ns" \
   --no-timing \
   --top-module ysyxSoCTop \
+  "${CORE_DEFINES[@]}" \
+  "${SOC_OPTS[@]}" \
   --Mdir "$OBJ_SOC"
 
 if [[ "$DEBUG_BUILD" -eq 1 ]]; then
@@ -66,19 +256,27 @@ if [[ "$DEBUG_BUILD" -eq 1 ]]; then
   make -C "$OBJ_SOC" -f VysyxSoCTop.mk libVysyxSoCTop.a \
     OPT_FAST="-O0 -g3 -fno-omit-frame-pointer" \
     OPT_SLOW="-O0 -g3 -fno-omit-frame-pointer"
+elif [[ -n "$PGO_BUILD" ]]; then
+  # NOTE: the flags differ between pgo-gen and pgo-use, make does not see that (lto rebuilds the same way)
+  rm -f "$OBJ_CPU"/*.o "$OBJ_CPU"/*.a "$OBJ_SOC"/*.o "$OBJ_SOC"/*.a
+  make -C "$OBJ_CPU" -f Vcpu.mk libVcpu.a "${MAKE_OPTS[@]}"
+  make -C "$OBJ_SOC" -f VysyxSoCTop.mk libVysyxSoCTop.a "${MAKE_OPTS[@]}"
 else
   # No OPT_FAST/OPT_SLOW overrides
   make -C "$OBJ_CPU" -f Vcpu.mk libVcpu.a
   make -C "$OBJ_SOC" -f VysyxSoCTop.mk libVysyxSoCTop.a
 fi
 
-g++ -std=c++17 -g \
+g++ -std=c++20 -g \
+  "${TB_OPT[@]}" \
+  "${TB_DEFINES[@]}" \
   -I"$OBJ_CPU" -I"$OBJ_SOC" \
   -I"$VERILATOR_ROOT/include" \
   -I"$VERILATOR_ROOT/include/vltstd" \
   soc/soc_main.cpp \
   "$OBJ_SOC/libVysyxSoCTop.a" "$OBJ_CPU/libVcpu.a" \
   libverilated.a \
+  -pthread \
   -o "$TB_BIN"
 
 cd - >/dev/null
@@ -0,0 +1,3 @@
+#!/bin/bash
+# The directed div/rem programs, see random_test.sh
+./random_test.sh "${1:-vsoc}" directed
@@ -1,3 +1,7 @@
+#!/usr/bin/env bash
+# NOTE: a failed synthesis, sta or microbench run stops here, no row is built from the reports of a previous run
+set -euo pipefail
+
 YOSYS_PATH="yosys-sta"
 MICROBENCH_PATH="am-kernels/benchmarks/microbench"
 ROOT_DIR="$(pwd)"
@@ -5,26 +9,80 @@ MEASURE_TEMP="${ROOT_DIR}/__temp_measure.txt"
 MEASURE_CSV="${ROOT_DIR}/measure.csv"
 FREQ_TEMP="${ROOT_DIR}/__temp_freq.txt"
 DEVICE_DELAY_FILE="${ROOT_DIR}/soc/freq_defines.vh"
+CORE_DEFINES_FILE="${ROOT_DIR}/soc/core_defines.vh"
+ICACHE_DEFINES_FILE="${ROOT_DIR}/soc/icache_defines.vh"
+# CPU_CORE=pipe : synthesis and microbench of the pipelined core, written in the notes column
+export CPU_CORE="${CPU_CORE:-multi}"
+# DCACHE=1      : with the data cache, written in the notes column
+export DCACHE="${DCACHE:-0}"
+# ICACHE_PREFETCH=0 : synthesis and microbench without the icache prefetch, written in the notes column
+ICACHE_PREFETCH="${ICACHE_PREFETCH:-1}"
+# MEASURE_CPU=vcpu : microbench on vcpu with the timing model VCPU_TIMING (default soc) instead of vsoc
+# XIP_BURST=1      : vcpu flash reads stream consecutive words (xip-burst), written in the notes column
+# AM_ARCH=<arch>   : microbench built for the abstract-machine <arch> (default minirv-npc), written in the notes column
+MEASURE_CPU="${MEASURE_CPU:-vsoc}"
+AM_ARCH="${AM_ARCH:-minirv-npc}"
+export XIP_BURST="${XIP_BURST:-0}"
+NOTES="$CPU_CORE"
+if [[ "$DCACHE" == "1" ]]; then
+  NOTES="$NOTES dcache"
+fi
+if [[ "$ICACHE_PREFETCH" == "0" ]]; then
+  NOTES="$NOTES no-prefetch"
+fi
+if [[ "$AM_ARCH" != "minirv-npc" ]]; then
+  NOTES="$NOTES $AM_ARCH"
+fi
+if [[ "$MEASURE_CPU" == "vcpu" ]]; then
+  export VCPU_TIMING="${VCPU_TIMING:-soc}"
+  NOTES="$NOTES vcpu $VCPU_TIMING"
+  if [[ "$XIP_BURST" == "1" ]]; then
+    NOTES="$NOTES xip-burst"
+  fi
+fi
 
-printf "%s,%s,%s," "$(git rev-parse HEAD)" "$(date +"%Y-%m-%dT%H:%M:%S")" "text" > "$MEASURE_TEMP"
+printf "%s,%s,%s," "$(git rev-parse HEAD)" "$(date +"%Y-%m-%dT%H:%M:%S")" "$NOTES" > "$MEASURE_TEMP"
 
+cp "$CORE_DEFINES_FILE" "$CORE_DEFINES_FILE.bak"
+# NOTE: the defines below must not stay in the tracked file when the synthesis fails or the run is interrupted
+restore_core_defines() {
+  if [[ -f "$CORE_DEFINES_FILE.bak" ]]; then
+    mv "$CORE_DEFINES_FILE.bak" "$CORE_DEFINES_FILE"
+  fi
+}
+# NOTE: the prefetch is a localparam read by the simulation too, it is restored only at exit
+restore_icache_defines() {
+  if [[ -f "$ICACHE_DEFINES_FILE.bak" ]]; then
+    mv "$ICACHE_DEFINES_FILE.bak" "$ICACHE_DEFINES_FILE"
+  fi
+}
+trap 'restore_core_defines; restore_icache_defines; rm -f "$MEASURE_TEMP" "$FREQ_TEMP"' EXIT
+if [[ "$ICACHE_PREFETCH" == "0" ]]; then
+  cp "$ICACHE_DEFINES_FILE" "$ICACHE_DEFINES_FILE.bak"
+  sed -i 's/^localparam ICACHE_PREFETCH *= *1;/localparam ICACHE_PREFETCH   = 0;/' "$ICACHE_DEFINES_FILE"
+fi
+if [[ "$CPU_CORE" == "pipe" ]]; then
+  echo '`define CPU_PIPE' >> "$CORE_DEFINES_FILE"
+fi
+if [[ "$DCACHE" == "1" ]]; then
+  echo '`define DCACHE' >> "$CORE_DEFINES_FILE"
+fi
 cd "$YOSYS_PATH"
+rm -f result/cpu-100MHz/cpu.rpt result/cpu-100MHz/synth_stat.txt result/cpu-100MHz/cpu.pwr
 make syn
 make sta
+restore_core_defines
 python "$ROOT_DIR/scripts/freq.py"  result/cpu-100MHz/cpu.rpt > "$FREQ_TEMP"
+AREA="$(python "$ROOT_DIR/scripts/area.py"  result/cpu-100MHz/synth_stat.txt)"
+POWER="$(python "$ROOT_DIR/scripts/power.py" result/cpu-100MHz/cpu.pwr)"
 
-printf "%s,%s,%s," \
-  "$(cat "$FREQ_TEMP")" \
-  "$(python "$ROOT_DIR/scripts/area.py"  result/cpu-100MHz/synth_stat.txt)" \
-  "$(python "$ROOT_DIR/scripts/power.py" result/cpu-100MHz/cpu.pwr)" >> "$MEASURE_TEMP"
+printf "%s,%s,%s," "$(cat "$FREQ_TEMP")" "$AREA" "$POWER" >> "$MEASURE_TEMP"
 
 python -c 'import sys; print("localparam RS = ", round(float(sys.stdin.read())*1000), ";")' <<< "$(cat "$FREQ_TEMP")"  > "$DEVICE_DELAY_FILE"
 cd - >/dev/null
 
 cd "$MICROBENCH_PATH"
-make ARCH=minirv-npc run verbose=4 cpu=vsoc measure_path="$MEASURE_TEMP" mainargs=train
+make ARCH="$AM_ARCH" run verbose=4 cpu="$MEASURE_CPU" measure_path="$MEASURE_TEMP" mainargs=train
 cd - >/dev/null
 
 cat "$MEASURE_TEMP" >> "$MEASURE_CSV"
-rm "$MEASURE_TEMP"
-rm "$FREQ_TEMP"
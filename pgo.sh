@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+# Profile-guided build of the vsoc/vcpu testbench:
+# pgo-gen build, training on microbench train and a subset of cpu-tests, pgo-use build, speedup over lto
+# (the same -O2 LTO flags without the profiles, so the delta is the gain of the profiles only)
+set -euo pipefail
+
+MICROBENCH_PATH=am-kernels/benchmarks/microbench
+CPU_TESTS=am-kernels/tests/cpu-tests
+PGO_TESTS=(add bubble-sort quick-sort matrix-mul string crc32 fib)
+PGO_DIR="${PGO_DIR:-$(pwd)/pgo}"
+export PGO_DIR
+
+MICROBENCH_BIN="$MICROBENCH_PATH/build/microbench-minirv-npc.bin"
+TB_PGO="./bin/testbench_pgo"
+TB_LTO="./bin/testbench_lto"
+if [[ "${THREADS:-1}" -gt 1 ]]; then
+  TB_PGO="${TB_PGO}_t${THREADS}"
+  TB_LTO="${TB_LTO}_t${THREADS}"
+fi
+
+usage() {
+  echo "Usage:"
+  echo "  $0   # PGO_DIR=<path> THREADS=<n> are passed to build_run.sh"
+}
+
+if [[ $# -gt 0 ]]; then
+  usage
+  exit 1
+fi
+
+make -C "$MICROBENCH_PATH" ARCH=minirv-npc mainargs=train
+make -C "$CPU_TESTS" ARCH=minirv-npc ALL="${PGO_TESTS[*]}"
+
+rm -rf "$PGO_DIR"
+mkdir -p "$PGO_DIR"
+
+# NOTE: the first run builds the instrumented testbench, the others reuse it
+./build_run.sh pgo-gen vsoc verbose 4 bin "$MICROBENCH_BIN"
+"$TB_PGO" vcpu verbose 4 bin "$MICROBENCH_BIN"
+for t in "${PGO_TESTS[@]}"; do
+  "$TB_PGO" vsoc bin "$CPU_TESTS/build/$t-minirv-npc.bin"
+  "$TB_PGO" vcpu bin "$CPU_TESTS/build/$t-minirv-npc.bin"
+done
+if [[ -f profile.vlt ]]; then
+  mv profile.vlt "$PGO_DIR/profile.vlt"
+fi
+
+khz() {
+  grep -o "\[INFO\] $1 speed: [0-9.]*" | awk '{ print $4 }' | tail -1
+}
+
+LTO_LOG="$(mktemp)"
+PGO_LOG="$(mktemp)"
+trap 'rm -f "$LTO_LOG" "$PGO_LOG"' EXIT
+
+./build_run.sh pgo-use vsoc vcpu verbose 4 bin "$MICROBENCH_BIN" > /dev/null
+./build_run.sh lto     vsoc vcpu verbose 4 bin "$MICROBENCH_BIN" > /dev/null
+for cpu in vsoc vcpu; do
+  "$TB_LTO" "$cpu" verbose 4 bin "$MICROBENCH_BIN" >> "$LTO_LOG"
+  "$TB_PGO" "$cpu" verbose 4 bin "$MICROBENCH_BIN" >> "$PGO_LOG"
+done
+
+printf "%-6s %12s %12s %8s\n" "model" "lto kHz" "pgo kHz" "speedup"
+for cpu in vsoc vcpu; do
+  LTO_KHZ="$(khz "$cpu" < "$LTO_LOG")"
+  PGO_KHZ="$(khz "$cpu" < "$PGO_LOG")"
+  printf "%-6s %12s %12s %8s\n" "$cpu" "$LTO_KHZ" "$PGO_KHZ" \
+    "$(awk -v f="$LTO_KHZ" -v p="$PGO_KHZ" 'BEGIN { if (f > 0) printf "%.2fx", p / f; else printf "-" }')"
+done
@@ -1,13 +1,13 @@
-CPU_TESTS=am-kernels/tests/cpu-tests
+#!/bin/bash
 
 usage() {
   echo "Usage:"
-  echo "  $0 vsoc"
-  echo "  $0 vcpu"
+  echo "  $0 vsoc [directed]"
+  echo "  $0 vcpu [directed]"
 }
 
 CPU="${1:-vsoc}"
-shift || true
+TEST="${2:-random}"
 
 case "$CPU" in
   vsoc)
@@ -20,4 +20,16 @@ case "$CPU" in
     ;;
 esac
 
-./build_run.sh fast "$CPU" gold random 1000 100 all delay 1 2 verbose 4
+case "$TEST" in
+  random)
+    ./build_run.sh fast "$CPU" gold random 1000 100 all+ delay 1 2 verbose 4
+    ;;
+  directed)
+    # NOTE: CPU_CORE=pipe runs it on the pipelined core, where the division may start before the load is answered
+    ./build_run.sh fast "$CPU" gold directed delay 1 4 check verbose 4
+    ;;
+  *)
+    usage
+    exit 1
+    ;;
+esac
@@ -11,6 +11,16 @@ module alu (
 
   logic [4:0] shamt;
 
+  // NOTE: one 33x33 signed multiplier for the four M multiplications, single cycle;
+  // the operands are sign or zero extended by the op (MULH both, MULHSU lhs only)
+  logic signed [32:0] mul_lhs;
+  logic signed [32:0] mul_rhs;
+  logic        [63:0] product;
+
+  assign mul_lhs = {(op == ALU_OP_MULH || op == ALU_OP_MULHSU) && lhs[31], lhs};
+  assign mul_rhs = {op == ALU_OP_MULH && rhs[31], rhs};
+  assign product = 64'(mul_lhs * mul_rhs);
+
   always_comb begin
     shamt = rhs[4:0];
     case (op)
@@ -27,6 +37,10 @@ module alu (
       ALU_OP_SLTU:res = { 31'b0, lhs < rhs };
       ALU_OP_LHS: res = lhs;
       ALU_OP_RHS: res = rhs;
+      ALU_OP_MUL:    res = product[31:0];
+      ALU_OP_MULH:   res = product[63:32];
+      ALU_OP_MULHSU: res = product[63:32];
+      ALU_OP_MULHU:  res = product[63:32];
       default:    res = 32'b0;
     endcase
   end
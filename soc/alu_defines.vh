@@ -1,15 +1,23 @@
-localparam ALU_OP_END  = 3; 
-localparam ALU_OP_ADD  = 4'b0000; 
-localparam ALU_OP_SLL  = 4'b0001; 
-localparam ALU_OP_SLT  = 4'b0010; 
-localparam ALU_OP_SLTU = 4'b0011; 
-localparam ALU_OP_XOR  = 4'b0100; 
-localparam ALU_OP_SRL  = 4'b0101; 
-localparam ALU_OP_OR   = 4'b0110; 
-localparam ALU_OP_AND  = 4'b0111; 
-localparam ALU_OP_ANDN = 4'b1111; 
-localparam ALU_OP_LHS  = 4'b1010; 
-localparam ALU_OP_RHS  = 4'b1011; 
-localparam ALU_OP_SUB  = 4'b1000; 
-localparam ALU_OP_SRA  = 4'b1101; 
-
+localparam ALU_OP_END    = 4; 
+localparam ALU_OP_ADD    = 5'b00000; 
+localparam ALU_OP_SLL    = 5'b00001; 
+localparam ALU_OP_SLT    = 5'b00010; 
+localparam ALU_OP_SLTU   = 5'b00011; 
+localparam ALU_OP_XOR    = 5'b00100; 
+localparam ALU_OP_SRL    = 5'b00101; 
+localparam ALU_OP_OR     = 5'b00110; 
+localparam ALU_OP_AND    = 5'b00111; 
+localparam ALU_OP_ANDN   = 5'b01111; 
+localparam ALU_OP_LHS    = 5'b01010; 
+localparam ALU_OP_RHS    = 5'b01011; 
+localparam ALU_OP_SUB    = 5'b01000; 
+localparam ALU_OP_SRA    = 5'b01101; 
+// M extension, {1'b1, 1'b0, funct3}; the divisions come from div.sv
+localparam ALU_OP_MUL    = 5'b10000; 
+localparam ALU_OP_MULH   = 5'b10001; 
+localparam ALU_OP_MULHSU = 5'b10010; 
+localparam ALU_OP_MULHU  = 5'b10011; 
+localparam ALU_OP_DIV    = 5'b10100; 
+localparam ALU_OP_DIVU   = 5'b10101; 
+localparam ALU_OP_REM    = 5'b10110; 
+localparam ALU_OP_REMU   = 5'b10111; 
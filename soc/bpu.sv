@@ -0,0 +1,87 @@
+module bpu #(
+  parameter BTB_ENTRIES = 16,
+  parameter BHT_ENTRIES = 64
+) (
+  input  logic        clock,
+  input  logic        reset,
+
+  // NOTE: prediction of the fetch at pc, next_pc is the pc after it (+2 for a 16-bit instruction, is_rvc,
+  // +4 otherwise) unless a taken branch or a jump is predicted
+  input  logic [31:0] pc,
+  input  logic        is_rvc,
+  output logic        is_btb_hit,
+  output logic [31:0] next_pc,
+
+  // NOTE: a branch or a jump when it is resolved, it allocates an entry when taken
+  input  logic        update,
+  input  logic        update_is_jump,
+  input  logic        update_is_taken,
+  input  logic [31:1] update_pc,
+  input  logic [31:1] update_target);
+
+  localparam n     = $clog2(BTB_ENTRIES);
+  localparam h     = $clog2(BHT_ENTRIES);
+  localparam TAG_W = 31-n;
+
+/*
+      BTB, BTB_ENTRIES                        BHT, BHT_ENTRIES
+  +---+------+-----+--------+                 +---------------+
+  | 1 | 1    |TAG_W| 31     |                 | 2             |
+  +---+------+-----+--------+                 +---------------+
+  | v | jump | tag | target |                 | counter       |
+  +---+------+-----+--------+                 +---------------+
+*/
+
+  logic             valid   [0:BTB_ENTRIES-1];
+  logic             is_jump [0:BTB_ENTRIES-1];
+  logic [TAG_W-1:0] tags    [0:BTB_ENTRIES-1];
+  logic [31:1]      targets [0:BTB_ENTRIES-1];
+  logic [1:0]       bht     [0:BHT_ENTRIES-1];
+
+  logic [n-1:0] index;
+  logic [h-1:0] bht_index;
+  logic         is_taken;
+  assign index     = pc[n:1];
+  assign bht_index = pc[h:1];
+
+  assign is_btb_hit = valid[index] && tags[index] == pc[31:1+n];
+  assign is_taken   = is_btb_hit && (is_jump[index] || bht[bht_index][1]);
+  assign next_pc    = is_taken ? {targets[index], 1'b0} : pc + (is_rvc ? 32'd2 : 32'd4);
+
+  logic [n-1:0] update_index;
+  logic [h-1:0] update_bht_index;
+  assign update_index     = update_pc[n:1];
+  assign update_bht_index = update_pc[h:1];
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      for (int i = 0; i < BTB_ENTRIES; i++) begin
+        valid[i] <= 1'b0;
+      end
+    end
+    else if (update && update_is_taken) begin
+      valid  [update_index] <= 1'b1;
+      is_jump[update_index] <= update_is_jump;
+      tags   [update_index] <= update_pc[31:1+n];
+      targets[update_index] <= update_target;
+    end
+  end
+
+  // NOTE: 2 bit saturating counters of the branches, from weakly not taken
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      for (int i = 0; i < BHT_ENTRIES; i++) begin
+        bht[i] <= 2'b01;
+      end
+    end
+    else if (update && !update_is_jump) begin
+      if (update_is_taken && bht[update_bht_index] != 2'b11) begin
+        bht[update_bht_index] <= bht[update_bht_index] + 2'd1;
+      end
+      else if (!update_is_taken && bht[update_bht_index] != 2'b00) begin
+        bht[update_bht_index] <= bht[update_bht_index] - 2'd1;
+      end
+    end
+  end
+
+endmodule
@@ -0,0 +1,3 @@
+// size of the branch predictor of the pipelined core, powers of 2
+localparam BPU_BTB_ENTRIES = 16;
+localparam BPU_BHT_ENTRIES = 64;
@@ -0,0 +1,57 @@
+#include <cstdint>
+#include <cstdio>
+
+// NOTE: the bytes every model transmits through the uart THR, captured when the instruction retires.
+// One model echoes to the host stream, block buffered and flushed on newlines;
+// the others are only counted and hashed, to check at the end of a test that all printed the same.
+#define CONSOLE_BUFFER (4096)
+#define UART_LCR_DLAB  (0x80)
+
+enum ConsoleModel {
+  Console_Vsoc,
+  Console_Vcpu,
+  Console_Gold,
+  Console_Count,
+};
+
+static const char* console_model_names[] = { "vsoc", "vcpu", "gold" };
+
+struct Console {
+  bool     is_echo;
+  FILE*    stream;
+  char     buffer[CONSOLE_BUFFER];
+  uint32_t size;
+  uint64_t bytes;
+  uint64_t hash;
+};
+
+void console_flush(Console* console) {
+  if (console->is_echo && console->size) {
+    fwrite(console->buffer, 1, console->size, console->stream);
+    fflush(console->stream);
+  }
+  console->size = 0;
+}
+
+// NOTE: FNV-1a of the whole output
+void console_reset(Console* console, bool is_echo, FILE* stream) {
+  console_flush(console);
+  console->is_echo = is_echo;
+  console->stream  = stream;
+  console->bytes   = 0;
+  console->hash    = 0xcbf29ce484222325ull;
+}
+
+void console_put(Console* console, uint8_t byte) {
+  console->bytes++;
+  console->hash = (console->hash ^ byte) * 0x100000001b3ull;
+  if (!console->is_echo) return;
+  console->buffer[console->size++] = byte;
+  if (byte == '\n' || console->size == CONSOLE_BUFFER) {
+    console_flush(console);
+  }
+}
+
+bool console_equal(Console* a, Console* b) {
+  return a->bytes == b->bytes && a->hash == b->hash;
+}
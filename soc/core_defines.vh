@@ -0,0 +1,2 @@
+// core selection for the synthesis, measure.sh adds `define CPU_PIPE / `define DCACHE here while yosys runs;
+// the verilator builds get +define+CPU_PIPE / +define+DCACHE from build_run.sh (CPU_CORE=pipe, DCACHE=1)
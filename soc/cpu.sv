@@ -1,18 +1,23 @@
-module cpu (
+`include "core_defines.vh"
+`ifndef CPU_PIPE
+// NOTE: the multicycle core, cpu_pipe.sv is the pipelined one built with +define+CPU_PIPE
+module cpu #(
+  parameter BUS_DEPTH = 1 // ifu requests in flight, vcpu only (BUS_DEPTH=<n> ./build_run.sh)
+) (
   input         clock,
   input         reset,
 
   input  [31:0] io_ifu_rdata,
-  input         io_ifu_respValid,
-  output        io_ifu_reqValid,
-  output [31:0] io_ifu_addr,
+  input         io_ifu_respValid /* verilator public_flat_rd */,
+  output        io_ifu_reqValid  /* verilator public_flat_rd */,
+  output [31:0] io_ifu_addr      /* verilator public_flat_rd */,
 
-  input         io_lsu_respValid,
+  input         io_lsu_respValid /* verilator public_flat_rd */,
   input  [31:0] io_lsu_rdata,
-  output        io_lsu_reqValid,
-  output [31:0] io_lsu_addr,
+  output        io_lsu_reqValid  /* verilator public_flat_rd */,
+  output [31:0] io_lsu_addr      /* verilator public_flat_rd */,
   output [1:0]  io_lsu_size,
-  output        io_lsu_wen,
+  output        io_lsu_wen       /* verilator public_flat_rd */,
   output [31:0] io_lsu_wdata,
   output [3:0]  io_lsu_wmask);
 
@@ -21,6 +26,7 @@ module cpu (
 `include "reg_defines.vh"
 `include "alu_defines.vh"
 `include "inst_defines.vh"
+`include "perf_defines.vh"
 /* verilator lint_on UNUSEDPARAM */
               
 /*
@@ -40,6 +46,7 @@ start ------->|IFU|------->|IDU| -------> |LSU|
   logic [REG_W_END:0]     idu_imm;
   logic [ALU_OP_END:0]    idu_alu_op;
   logic [COM_OP_END:0]    idu_com_op;
+  logic                   idu_is_rvc;
 
   logic [REG_W_END:0] pc;
   logic               pc_wen;
@@ -49,14 +56,25 @@ start ------->|IFU|------->|IDU| -------> |LSU|
   logic [REG_W_END:0] pc_inc;
 
   logic               rf_wen;
+  logic [REG_A_END:0] rf_rd;
 
   logic [REG_W_END:0] rf_wdata;
   logic [REG_W_END:0] rf_rdata1;
   logic [REG_W_END:0] rf_rdata2;
 
+  logic               exu_rf_wen;
+  logic [REG_W_END:0] exu_rf_wdata;
+  logic [REG_W_END:0] exu_rdata1;
+  logic [REG_W_END:0] exu_pc;
+  logic [REG_W_END:0] exu_res;
+
   logic [REG_W_END:0] ifu_inst;
-  logic               ifu_respValid;
-  logic               ifu_reqValid;
+  logic               ifu_respValid /* verilator public_flat_rd */;
+  logic               ifu_reqValid  /* verilator public_flat_rd */;
+  logic [REG_W_END:0] word_pc;
+  logic [REG_W_END:0] word_inst;
+  logic               word_respValid;
+  logic               word_reqValid;
 
   logic               idu_respValid;
   logic               idu_reqValid;
@@ -64,16 +82,45 @@ start ------->|IFU|------->|IDU| -------> |LSU|
   logic               exu_reqValid;
 
   logic               is_lsu_inst;
-  logic               is_store;
+  logic               is_store      /* verilator public_flat_rd */;
 
   logic [REG_W_END:0] lsu_rdata;
-  logic [REG_W_END:0] lsu_wdata;
-  logic [REG_W_END:0] lsu_addr;
-  logic               lsu_respValid;
-  logic               lsu_reqValid;
+  logic [REG_W_END:0] lsu_wdata     /* verilator public_flat_rd */;
+  logic [REG_W_END:0] lsu_addr      /* verilator public_flat_rd */;
+  logic               lsu_respValid /* verilator public_flat_rd */;
+  logic               lsu_reqValid  /* verilator public_flat_rd */;
 
   logic [REG_W_END:0] csr_rdata;
 
+  logic               is_fuse_head;
+  logic               is_fusing;
+  logic               is_fuse_head_valid;
+  logic               is_fuse_head_decode;
+  logic               is_fuse_tail;
+  logic               is_fuse_pair;
+  logic               is_fused;
+  logic               is_fuse_alone;
+  logic               is_fuse_replay;
+  logic               is_fuse_upper;
+  logic [REG_A_END:0] fuse_rd;
+  logic [REG_W_END:0] fuse_value;
+  logic [REG_W_END:0] fuse_pc;
+  logic [REG_W_END:0] fetch_pc;
+
+  logic                     exu_instret;
+  logic [1:0]               instret;
+  logic [PERF_EXU_END:0]    exu_perf_events;
+  logic                     ifu_icache_hit;
+  logic                     ifu_icache_miss;
+  logic                     ifu_icache_refill;
+  logic                     ifu_prefetch_useful;
+  logic                     ifu_prefetch_useless;
+  logic                     lsu_is_busy;
+  logic                     lsu_dcache_hit;
+  logic                     lsu_dcache_miss;
+  logic                     lsu_dcache_writeback;
+  logic [PERF_EVENTS_END:0] perf_events;
+
   pc u_pc(
     .clock(clock),
     .reset(reset),
@@ -81,19 +128,39 @@ start ------->|IFU|------->|IDU| -------> |LSU|
     .wdata(pc_next),
     .rdata(pc));
 
-  ifu u_ifu(
+  ifu_align u_ifu_align(
+    .clock(clock),
+    .reset(reset),
+    .pc            (fetch_pc),
+    .reqValid      (ifu_reqValid),
+    .respValid     (ifu_respValid),
+    .inst          (ifu_inst),
+    .word_pc       (word_pc),
+    .word_reqValid (word_reqValid),
+    .word_respValid(word_respValid),
+    .word_inst     (word_inst));
+
+  ifu #(
+    .BUS_DEPTH(BUS_DEPTH)
+  ) u_ifu(
     .clock(clock),
     .reset(reset),
-    .respValid   (ifu_respValid),
-    .reqValid    (ifu_reqValid),
+    .respValid   (word_respValid),
+    .reqValid    (word_reqValid),
 
     .io_respValid(io_ifu_respValid),
     .io_reqValid (io_ifu_reqValid),
     .io_addr     (io_ifu_addr),
     .io_rdata    (io_ifu_rdata),
 
-    .pc          (pc),
-    .inst        (ifu_inst));
+    .pc          (word_pc),
+    .is_lsu_busy (lsu_is_busy),
+    .is_icache_hit      (ifu_icache_hit),
+    .is_icache_miss     (ifu_icache_miss),
+    .is_icache_refill   (ifu_icache_refill),
+    .is_prefetch_useful (ifu_prefetch_useful),
+    .is_prefetch_useless(ifu_prefetch_useless),
+    .inst        (word_inst));
 
   assign idu_reqValid = ifu_respValid;
   idu u_idu(
@@ -103,6 +170,7 @@ start ------->|IFU|------->|IDU| -------> |LSU|
     .reqValid (idu_reqValid),
 
     .inst_in  (ifu_inst),
+    .is_rvc   (idu_is_rvc),
 
     .rd       (idu_rd),
     .rs1      (idu_rs1),
@@ -118,22 +186,44 @@ start ------->|IFU|------->|IDU| -------> |LSU|
 
     .wen   (rf_wen),
     .wdata (rf_wdata),
-    .rd    (idu_rd),
+    .rd    (rf_rd),
     .rs1   (idu_rs1),
     .rs2   (idu_rs2),
     .rdata1(rf_rdata1),
     .rdata2(rf_rdata2));
 
+  always_comb begin
+    perf_events                        = 0;
+    perf_events[PERF_EXU_END:0]        = exu_perf_events;
+    perf_events[PERF_CALC]             = exu_perf_events[PERF_CALC] || is_fuse_head_decode;
+    perf_events[PERF_ICACHE_HIT]       = ifu_icache_hit;
+    perf_events[PERF_ICACHE_MISS]      = ifu_icache_miss;
+    perf_events[PERF_ICACHE_REFILL]    = ifu_icache_refill;
+    perf_events[PERF_DCACHE_HIT]       = lsu_dcache_hit;
+    perf_events[PERF_DCACHE_MISS]      = lsu_dcache_miss;
+    perf_events[PERF_DCACHE_WRITEBACK] = lsu_dcache_writeback;
+    perf_events[PERF_PREFETCH_USEFUL]  = ifu_prefetch_useful;
+    perf_events[PERF_PREFETCH_USELESS] = ifu_prefetch_useless;
+    perf_events[PERF_FUSED]            = is_fused;
+  end
+
+  // NOTE: a fused pair retires two instructions in its cycle, the head retired alone one.
+  // The head (always calc) is counted in its decode cycle, the exu never sees it and a calc tail
+  // needs the calc bit in the pair cycle, so the class counters add up to minstret either way
+  assign instret = is_fused ? 2'd2 : {1'b0, exu_instret || is_fuse_alone};
+
   csr u_csr(
     .clock(clock),
     .reset(reset),
+    .instret    (instret),
+    .perf_events(perf_events),
     .addr (idu_imm[11:0]),
     .rdata(csr_rdata));
 
   assign is_lsu_inst = idu_inst_type[4];
   assign is_store    = idu_inst_type[5:3] == INST_STORE;
 
-  assign lsu_reqValid = idu_respValid && is_lsu_inst;
+  assign lsu_reqValid = exu_reqValid && is_lsu_inst;
   lsu u_lsu(
     .clock(clock),
     .reset(reset),
@@ -154,16 +244,97 @@ start ------->|IFU|------->|IDU| -------> |LSU|
     .io_addr      (io_lsu_addr),
     .io_size      (io_lsu_size),
     .io_wen       (io_lsu_wen),
-    .io_wmask     (io_lsu_wmask));
+    .io_wmask     (io_lsu_wmask),
+
+    .is_busy            (lsu_is_busy),
+    .is_dcache_hit      (lsu_dcache_hit),
+    .is_dcache_miss     (lsu_dcache_miss),
+    .is_dcache_writeback(lsu_dcache_writeback));
+
+  // NOTE: macro-op fusion. The heads are lui/auipc and slt/sltu/slti/sltiu writing a register, they are
+  // found in the fetched instruction, so that the next one is fetched at once, at fuse_pc, without waiting
+  // for the exu. The head is not executed: in its decode cycle its alu result is kept in fuse_value.
+  // The next instruction fuses with it when it is
+  // - addi rd, rd, imm or jalr rd, imm(rd) after lui/auipc rd (a 32-bit constant, a far call),
+  // - beq/bne rd, x0 after the compare to rd,
+  // then the exu executes it with fuse_value as rs1 and the pair retires in one cycle, the branch pair
+  // writes fuse_value to rd. Otherwise the head retires alone in that cycle and the next instruction,
+  // still in the idu, goes to the exu in the cycle after, when rf has the head result.
+  assign is_fuse_head = !is_fusing && ifu_inst[11:7] != 0 &&
+                        (ifu_inst[6:0] == 7'b0110111 || ifu_inst[6:0] == 7'b0010111 ||                        // lui, auipc
+                         (ifu_inst[1:0] == 2'b01 && ifu_inst[15:13] == 3'b011 && ifu_inst[11:7] != 5'd2 &&    // c.lui
+                          {ifu_inst[12], ifu_inst[6:2]} != 0) ||
+                         (ifu_inst[6:0] == 7'b0010011 && ifu_inst[14:13] == 2'b01) ||                         // slti, sltiu
+                         (ifu_inst[6:0] == 7'b0110011 && ifu_inst[14:13] == 2'b01 && ifu_inst[31:25] == 0));  // slt, sltu
+
+  assign is_fuse_head_decode = idu_respValid && is_fusing && !is_fuse_head_valid;
+  assign is_fuse_tail        = idu_respValid && is_fuse_head_valid;
+  always_comb begin
+    is_fuse_pair = 1'b0;
+    if (idu_rs1 == fuse_rd) begin
+      if (is_fuse_upper) begin
+        is_fuse_pair = idu_rd == fuse_rd &&
+                       ((idu_inst_type == INST_IMM && idu_alu_op == ALU_OP_ADD) || idu_inst_type == INST_JUMPR);
+      end
+      else begin
+        is_fuse_pair = idu_inst_type == INST_BRANCH && idu_rs2 == 0 &&
+                       (idu_com_op == COM_OP_EQ || idu_com_op == COM_OP_NE);
+      end
+    end
+  end
+  assign is_fused      = is_fuse_tail && is_fuse_pair;
+  assign is_fuse_alone = is_fuse_tail && !is_fuse_pair;
+
+  assign fetch_pc   = is_fusing ? fuse_pc : pc;
+  assign exu_pc     = is_fuse_head_valid ? fuse_pc : pc;
+  assign exu_rdata1 = is_fused ? fuse_value : rf_rdata1;
 
-  assign pc_wen = exu_respValid;
-  assign pc_inc = pc + 4;
+  // NOTE: the head writes its result when it retires alone and in the branch pair, the exu writes nothing then
+  always_comb begin
+    rf_wen   = exu_rf_wen;
+    rf_rd    = idu_rd;
+    rf_wdata = exu_rf_wdata;
+    if (is_fuse_alone || (is_fused && !is_fuse_upper)) begin
+      rf_wen   = 1'b1;
+      rf_rd    = fuse_rd;
+      rf_wdata = fuse_value;
+    end
+  end
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      is_fusing          <= 1'b0;
+      is_fuse_head_valid <= 1'b0;
+      is_fuse_replay     <= 1'b0;
+    end else begin
+      is_fuse_replay <= is_fuse_alone;
+      if (ifu_respValid && is_fuse_head) begin
+        is_fusing <= 1'b1;
+        fuse_pc   <= pc + (ifu_inst[1:0] == 2'b11 ? 32'd4 : 32'd2);
+      end
+      if (is_fuse_head_decode) begin
+        is_fuse_head_valid <= 1'b1;
+        is_fuse_upper      <= idu_inst_type == INST_UPP || idu_inst_type == INST_AUIPC;
+        fuse_rd            <= idu_rd;
+        fuse_value         <= exu_res;
+      end
+      if (is_fuse_tail) begin
+        is_fusing          <= 1'b0;
+        is_fuse_head_valid <= 1'b0;
+      end
+    end
+  end
+
+  assign pc_wen = exu_respValid || is_fuse_alone;
+  assign pc_inc = exu_pc + (idu_is_rvc ? 32'd2 : 32'd4);
   always_comb begin
     pc_next = pc_inc;
     if (is_pc_jump) pc_next = pc_jump;
+    if (is_fuse_alone) pc_next = fuse_pc;
   end
 
-  assign exu_reqValid = idu_respValid;
+  // NOTE: the head waits for the instruction after it, a mismatched one is replayed from the idu
+  assign exu_reqValid = (idu_respValid && !is_fusing) || is_fused || is_fuse_replay;
   exu u_exu(
     .clock(clock),
     .reset(reset),
@@ -175,18 +346,22 @@ start ------->|IFU|------->|IDU| -------> |LSU|
 
     .lsu_rdata(lsu_rdata),
     .csr_rdata(csr_rdata),
-    .rdata1   (rf_rdata1),
+    .rdata1   (exu_rdata1),
     .rdata2   (rf_rdata2),
-    .pc       (pc),
+    .pc       (exu_pc),
     .pc_inc   (pc_inc),
 
     .is_pc_jump(is_pc_jump),
     .pc_jump   (pc_jump),
-    .rf_wdata  (rf_wdata),
-    .rf_wen    (rf_wen),
+    .rf_wdata  (exu_rf_wdata),
+    .rf_wen    (exu_rf_wen),
+    .alu_res   (exu_res),
     .lsu_wdata (lsu_wdata),
     .lsu_addr  (lsu_addr),
 
+    .is_instret (exu_instret),
+    .perf_events(exu_perf_events),
+
     .alu_op   (idu_alu_op),
     .com_op   (idu_com_op),
     .imm      (idu_imm),
@@ -199,7 +374,7 @@ start ------->|IFU|------->|IDU| -------> |LSU|
       is_start     <= 1'b1;
     end else begin
       is_start     <= 1'b0;
-      ifu_reqValid <= exu_respValid || is_start;
+      ifu_reqValid <= exu_respValid || is_start || (ifu_respValid && is_fuse_head);
     end
   end
 
@@ -236,4 +411,4 @@ end
 `endif
 
 endmodule
-
+`endif
@@ -0,0 +1,62 @@
+// NOTE: standalone cpu with its IFU/LSU ports on DPI memories, the testbench only drives clock/reset
+module cpu_dpi #(
+  parameter LATENCY = 0
+) (
+  input clock,
+  input reset);
+
+  logic        io_ifu_respValid;
+  logic [31:0] io_ifu_rdata;
+  logic        io_ifu_reqValid;
+  logic [31:0] io_ifu_addr;
+
+  logic        io_lsu_respValid;
+  logic [31:0] io_lsu_rdata;
+  logic        io_lsu_reqValid;
+  logic [31:0] io_lsu_addr;
+/* verilator lint_off UNUSEDSIGNAL */
+  logic [1:0]  io_lsu_size;
+/* verilator lint_on UNUSEDSIGNAL */
+  logic        io_lsu_wen;
+  logic [31:0] io_lsu_wdata;
+  logic [3:0]  io_lsu_wmask;
+
+  cpu u_cpu(
+    .clock           (clock),
+    .reset           (reset),
+    .io_ifu_rdata    (io_ifu_rdata),
+    .io_ifu_respValid(io_ifu_respValid),
+    .io_ifu_reqValid (io_ifu_reqValid),
+    .io_ifu_addr     (io_ifu_addr),
+    .io_lsu_respValid(io_lsu_respValid),
+    .io_lsu_rdata    (io_lsu_rdata),
+    .io_lsu_reqValid (io_lsu_reqValid),
+    .io_lsu_addr     (io_lsu_addr),
+    .io_lsu_size     (io_lsu_size),
+    .io_lsu_wen      (io_lsu_wen),
+    .io_lsu_wdata    (io_lsu_wdata),
+    .io_lsu_wmask    (io_lsu_wmask));
+
+  dpi_mem #(.LATENCY(LATENCY)) u_ifu_mem(
+    .clock    (clock),
+    .reset    (reset),
+    .reqValid (io_ifu_reqValid),
+    .addr     (io_ifu_addr),
+    .wen      (1'b0),
+    .wdata    (32'b0),
+    .wmask    (4'b0),
+    .respValid(io_ifu_respValid),
+    .rdata    (io_ifu_rdata));
+
+  dpi_mem #(.LATENCY(LATENCY), .IS_HELD(1)) u_lsu_mem(
+    .clock    (clock),
+    .reset    (reset),
+    .reqValid (io_lsu_reqValid),
+    .addr     (io_lsu_addr),
+    .wen      (io_lsu_wen),
+    .wdata    (io_lsu_wdata),
+    .wmask    (io_lsu_wmask),
+    .respValid(io_lsu_respValid),
+    .rdata    (io_lsu_rdata));
+
+endmodule
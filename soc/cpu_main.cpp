@@ -10,6 +10,7 @@
 
 #include "riscv.cpp"
 #include "c_dpi.h"
+#include "console.cpp"
 #include "gcpu.cpp"
 
 int read_bin_file(const char* path, uint8_t** out_data, size_t* out_size) {
@@ -0,0 +1,666 @@
+`include "core_defines.vh"
+`ifdef CPU_PIPE
+// NOTE: the pipelined core, built instead of the multicycle cpu.sv with +define+CPU_PIPE (CPU_CORE=pipe ./build_run.sh).
+// Same ports, same bus interfaces and the same names for the signals the testbench reads.
+module cpu #(
+  parameter BUS_DEPTH = 1 // ifu requests in flight, vcpu only (BUS_DEPTH=<n> ./build_run.sh)
+) (
+  input         clock,
+  input         reset,
+
+  input  [31:0] io_ifu_rdata,
+  input         io_ifu_respValid /* verilator public_flat_rd */,
+  output        io_ifu_reqValid  /* verilator public_flat_rd */,
+  output [31:0] io_ifu_addr      /* verilator public_flat_rd */,
+
+  input         io_lsu_respValid /* verilator public_flat_rd */,
+  input  [31:0] io_lsu_rdata,
+  output        io_lsu_reqValid  /* verilator public_flat_rd */,
+  output [31:0] io_lsu_addr      /* verilator public_flat_rd */,
+  output [1:0]  io_lsu_size,
+  output        io_lsu_wen       /* verilator public_flat_rd */,
+  output [31:0] io_lsu_wdata,
+  output [3:0]  io_lsu_wmask);
+
+/* verilator lint_off UNUSEDPARAM */
+`include "com_defines.vh"
+`include "reg_defines.vh"
+`include "alu_defines.vh"
+`include "inst_defines.vh"
+`include "perf_defines.vh"
+`include "bpu_defines.vh"
+/* verilator lint_on UNUSEDPARAM */
+
+/*
+     IF              ID              EX              MEM             WB
+   +---+  +-----+  +-------+       +---+           +---+           +---+
+   |IFU|->|queue|->|decoder|------>|EXU|---------->|LSU|---------->|RF |
+   +---+  +-----+  +-------+       +---+           +---+           +---+
+     ^                 ^            | ^              |               |
+     +--redirect-------+------------+ +--forward-----+---------------+
+*/
+
+  // NOTE: one instruction per stage, a stage moves on when the next one is free or moves on too.
+  // - IF keeps one fetch in flight on the IFU, through ifu_align.sv for the 16-bit instructions (RV32C);
+  //   its instruction goes to a 2 entry queue, the head is ID.
+  // - ID reads the registers (the retiring write included) and waits while an older load or csr read
+  //   in EX (or csr read in MEM) writes one of them, these get their result in MEM/WB.
+  // - EX takes its operands forwarded from MEM and WB, a division stays until div.sv answers; when its
+  //   next pc is not the one predicted at the fetch (bpu.sv), it flushes IF/ID and redirects the fetch
+  //   as it moves to MEM.
+  // - MEM issues the LSU request, WB retires: register, pc and minstret at the same posedge.
+  localparam REG_NUM = 16; // registers of rf.sv, the other ones are not written
+
+  function automatic logic is_forward(input logic valid, input logic [INST_TYPE_END:0] inst_type,
+                                      input logic [REG_A_END:0] rd, input logic [REG_A_END:0] rs);
+    is_forward = valid && inst_type[3] && rd != 0 && rd < REG_NUM && rd == rs;
+  endfunction
+
+  function automatic logic is_late(input logic [INST_TYPE_END:0] inst_type);
+    is_late = inst_type[5:3] == INST_LOAD || inst_type[5:3] == INST_SYSTEM;
+  endfunction
+
+  function automatic logic is_csr(input logic [INST_TYPE_END:0] inst_type);
+    is_csr = inst_type == INST_CSR || inst_type == INST_CSRI;
+  endfunction
+
+  function automatic logic is_div(input logic [INST_TYPE_END:0] inst_type, input logic [ALU_OP_END:0] alu_op);
+    is_div = inst_type == INST_REG && alu_op[4] && alu_op[2];
+  endfunction
+
+  // retired pc, what the testbench compares with the gold model
+  logic [REG_W_END:0] pc            /* verilator public_flat_rd */;
+  logic               pc_wen;
+
+  // IF
+  logic [REG_W_END:0] fetch_pc      /* verilator public_flat_rd */;
+  logic               fetch_pc_wen;
+  logic [REG_W_END:0] fetch_pc_next;
+  logic [REG_W_END:0] redirect_pc;
+  logic               is_fetch_wait;
+  logic               is_fetch_kill;
+  logic               is_fetch_busy;
+  logic               is_fetch_keep;
+  logic [1:0]         queue_count_next;
+  logic               bpu_is_btb_hit;
+  logic [REG_W_END:0] bpu_next_pc;
+
+  logic [REG_W_END:0] ifu_inst;
+  logic               ifu_respValid /* verilator public_flat_rd */;
+  logic               ifu_reqValid  /* verilator public_flat_rd */;
+  logic [REG_W_END:0] word_pc;
+  logic [REG_W_END:0] word_inst;
+  logic               word_respValid;
+  logic               word_reqValid;
+  logic               ifu_icache_hit;
+  logic               ifu_icache_miss;
+  logic               ifu_icache_refill;
+  logic               ifu_prefetch_useful;
+  logic               ifu_prefetch_useless;
+  logic               lsu_is_busy;
+  logic               lsu_dcache_hit;
+  logic               lsu_dcache_miss;
+  logic               lsu_dcache_writeback;
+
+  // ID, the head of the fetch queue, buf is the instruction fetched behind it
+  logic               id_valid;
+  logic [REG_W_END:0] id_pc;
+  logic [REG_W_END:0] id_inst;
+  logic [REG_W_END:0] id_pred_pc;
+  logic               buf_valid;
+  logic [REG_W_END:0] buf_pc;
+  logic [REG_W_END:0] buf_inst;
+  logic [REG_W_END:0] buf_pred_pc;
+
+  logic [REG_A_END:0]     id_rd;
+  logic [REG_A_END:0]     id_rs1;
+  logic [REG_A_END:0]     id_rs2;
+  logic [INST_TYPE_END:0] id_inst_type;
+  logic [REG_W_END:0]     id_imm;
+  logic [ALU_OP_END:0]    id_alu_op;
+  logic [COM_OP_END:0]    id_com_op;
+  logic                   id_is_rvc;
+
+  logic [REG_W_END:0] rf_rdata1;
+  logic [REG_W_END:0] rf_rdata2;
+  logic [REG_W_END:0] id_rdata1;
+  logic [REG_W_END:0] id_rdata2;
+  logic               is_id_rs1;
+  logic               is_id_rs2;
+  logic               is_hazard;
+  logic               is_id_issue;
+  logic               is_halted;
+
+  // EX
+  logic                   ex_valid;
+  logic [REG_W_END:0]     ex_pc;
+  logic [REG_W_END:0]     ex_pred_pc;
+  logic [REG_A_END:0]     ex_rd;
+  logic [REG_A_END:0]     ex_rs1;
+  logic [REG_A_END:0]     ex_rs2;
+  logic [REG_W_END:0]     ex_rdata1_q;
+  logic [REG_W_END:0]     ex_rdata2_q;
+  logic [REG_W_END:0]     ex_rdata1;
+  logic [REG_W_END:0]     ex_rdata2;
+  logic [INST_TYPE_END:0] ex_inst_type;
+  logic [REG_W_END:0]     ex_imm;
+  logic [ALU_OP_END:0]    ex_alu_op;
+  logic [COM_OP_END:0]    ex_com_op;
+  logic                   ex_is_rvc;
+
+  logic               ex_is_pc_jump;
+  logic               ex_is_branch_true;
+  logic [REG_W_END:0] ex_pc_next;
+  logic [REG_W_END:0] ex_result;
+  logic [REG_W_END:0] ex_lsu_addr;
+  logic               is_ex_ready;
+  logic               is_ex_div_req;
+  logic               is_ex_load_wait;
+  logic               ex_div_reqValid;
+  logic               ex_div_respValid;
+  logic               is_ex_div_done;
+  logic               is_ex_advance;
+  logic               is_redirect;
+  logic               is_bpu_update;
+
+  // MEM
+  logic                   mem_valid;
+  logic [REG_A_END:0]     mem_rd;
+  logic [INST_TYPE_END:0] mem_inst_type;
+  logic [11:0]            mem_csr_addr;
+  logic [REG_W_END:0]     mem_result;
+  logic [REG_W_END:0]     mem_pc_next;
+  logic                   mem_is_branch_true;
+  logic [REG_W_END:0]     mem_forward;
+
+  logic               is_mem_lsu;
+  logic               is_mem_issued;
+  logic               is_mem_done;
+  logic               is_mem_ready;
+  logic               is_mem_advance;
+
+  logic               is_store      /* verilator public_flat_rd */;
+  logic [REG_W_END:0] lsu_rdata;
+  logic [REG_W_END:0] lsu_wdata     /* verilator public_flat_rd */;
+  logic [REG_W_END:0] lsu_addr      /* verilator public_flat_rd */;
+  logic               lsu_respValid /* verilator public_flat_rd */;
+  logic               lsu_reqValid  /* verilator public_flat_rd */;
+
+  // WB
+  logic                   wb_valid;
+  logic [REG_A_END:0]     wb_rd;
+  logic [INST_TYPE_END:0] wb_inst_type;
+  logic [11:0]            wb_csr_addr;
+  logic [REG_W_END:0]     wb_result;
+  logic [REG_W_END:0]     wb_pc_next;
+  logic                   wb_is_branch_true;
+
+  logic               rf_wen;
+  logic [REG_W_END:0] rf_wdata;
+  logic [REG_W_END:0] csr_rdata;
+
+  logic [PERF_EVENTS_END:0] perf_events;
+
+  // ---------------------------------------------------------------- IF
+
+  pc u_pc(
+    .clock(clock),
+    .reset(reset),
+    .wen  (pc_wen),
+    .wdata(wb_pc_next),
+    .rdata(pc));
+
+  pc u_fetch_pc(
+    .clock(clock),
+    .reset(reset),
+    .wen  (fetch_pc_wen),
+    .wdata(fetch_pc_next),
+    .rdata(fetch_pc));
+
+  ifu_align u_ifu_align(
+    .clock(clock),
+    .reset(reset),
+    .pc            (fetch_pc),
+    .reqValid      (ifu_reqValid),
+    .respValid     (ifu_respValid),
+    .inst          (ifu_inst),
+    .word_pc       (word_pc),
+    .word_reqValid (word_reqValid),
+    .word_respValid(word_respValid),
+    .word_inst     (word_inst));
+
+  ifu #(
+    .BUS_DEPTH(BUS_DEPTH)
+  ) u_ifu(
+    .clock(clock),
+    .reset(reset),
+    .respValid   (word_respValid),
+    .reqValid    (word_reqValid),
+
+    .io_respValid(io_ifu_respValid),
+    .io_reqValid (io_ifu_reqValid),
+    .io_addr     (io_ifu_addr),
+    .io_rdata    (io_ifu_rdata),
+
+    .pc          (word_pc),
+    .is_lsu_busy (lsu_is_busy),
+    .is_icache_hit      (ifu_icache_hit),
+    .is_icache_miss     (ifu_icache_miss),
+    .is_icache_refill   (ifu_icache_refill),
+    .is_prefetch_useful (ifu_prefetch_useful),
+    .is_prefetch_useless(ifu_prefetch_useless),
+    .inst        (word_inst));
+
+  bpu #(
+    .BTB_ENTRIES(BPU_BTB_ENTRIES),
+    .BHT_ENTRIES(BPU_BHT_ENTRIES)
+  ) u_bpu(
+    .clock(clock),
+    .reset(reset),
+
+    .pc        (fetch_pc),
+    .is_rvc    (ifu_inst[1:0] != 2'b11),
+    .is_btb_hit(bpu_is_btb_hit),
+    .next_pc   (bpu_next_pc),
+
+    .update         (is_bpu_update),
+    .update_is_jump (ex_inst_type == INST_JUMP || ex_inst_type == INST_JUMPR),
+    .update_is_taken(ex_is_pc_jump),
+    .update_pc      (ex_pc[31:1]),
+    .update_target  (ex_pc_next[31:1]));
+
+  // NOTE: fetch_pc stays on the fetch in flight until its response, a redirect that comes before
+  // kills it and waits in redirect_pc; the next fetch is at the pc predicted for this one
+  assign is_fetch_busy = ifu_reqValid || is_fetch_wait;
+  assign is_fetch_keep = ifu_respValid && !is_fetch_kill && !is_redirect;
+
+  always_comb begin
+    fetch_pc_wen  = 1'b0;
+    fetch_pc_next = fetch_pc + 4;
+    if (is_redirect && is_fetch_busy && !ifu_respValid) begin
+      fetch_pc_wen  = 1'b0;
+    end
+    else if (is_redirect) begin
+      fetch_pc_wen  = 1'b1;
+      fetch_pc_next = ex_pc_next;
+    end
+    else if (ifu_respValid && is_fetch_kill) begin
+      fetch_pc_wen  = 1'b1;
+      fetch_pc_next = redirect_pc;
+    end
+    else if (is_fetch_keep) begin
+      fetch_pc_wen  = 1'b1;
+      fetch_pc_next = bpu_next_pc;
+    end
+  end
+
+  always_comb begin
+    queue_count_next = {1'b0, id_valid} + {1'b0, buf_valid} + {1'b0, is_fetch_keep} - {1'b0, is_id_issue};
+    if (is_redirect) queue_count_next = 2'd0;
+  end
+
+  // NOTE: the fetch request is a registered pulse, like the one of the multicycle core; the response
+  // may come in the same cycle, so a request goes out only when the queue has room for it
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      ifu_reqValid  <= 1'b0;
+      is_fetch_wait <= 1'b0;
+      is_fetch_kill <= 1'b0;
+      redirect_pc   <= 32'b0;
+    end
+    else begin
+      is_fetch_wait <= is_fetch_busy && !ifu_respValid;
+      ifu_reqValid  <= !(is_halted || (is_id_issue && id_inst_type == INST_EBREAK)) &&
+                       !(is_fetch_busy && !ifu_respValid) && queue_count_next < 2'd2;
+      if (is_redirect && is_fetch_busy && !ifu_respValid) begin
+        is_fetch_kill <= 1'b1;
+        redirect_pc   <= ex_pc_next;
+      end
+      else if (ifu_respValid) begin
+        is_fetch_kill <= 1'b0;
+      end
+    end
+  end
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      id_valid  <= 1'b0;
+      buf_valid <= 1'b0;
+    end
+    else if (is_redirect) begin
+      id_valid  <= 1'b0;
+      buf_valid <= 1'b0;
+    end
+    else if (is_id_issue) begin
+      if (buf_valid) begin
+        id_pc      <= buf_pc;
+        id_inst    <= buf_inst;
+        id_pred_pc <= buf_pred_pc;
+        buf_valid <= is_fetch_keep;
+      end
+      else begin
+        id_valid  <= is_fetch_keep;
+      end
+      if (buf_valid && is_fetch_keep) begin
+        buf_pc      <= fetch_pc;
+        buf_inst    <= ifu_inst;
+        buf_pred_pc <= bpu_next_pc;
+      end
+      else if (!buf_valid && is_fetch_keep) begin
+        id_pc      <= fetch_pc;
+        id_inst    <= ifu_inst;
+        id_pred_pc <= bpu_next_pc;
+      end
+    end
+    else if (is_fetch_keep) begin
+      if (!id_valid) begin
+        id_valid    <= 1'b1;
+        id_pc       <= fetch_pc;
+        id_inst     <= ifu_inst;
+        id_pred_pc  <= bpu_next_pc;
+      end
+      else begin
+        buf_valid   <= 1'b1;
+        buf_pc      <= fetch_pc;
+        buf_inst    <= ifu_inst;
+        buf_pred_pc <= bpu_next_pc;
+      end
+    end
+  end
+
+  // ---------------------------------------------------------------- ID
+
+  decoder u_decoder(
+    .inst     (id_inst),
+    .is_rvc   (id_is_rvc),
+    .rd       (id_rd),
+    .rs1      (id_rs1),
+    .rs2      (id_rs2),
+    .imm      (id_imm),
+    .alu_op   (id_alu_op),
+    .com_op   (id_com_op),
+    .inst_type(id_inst_type));
+
+  rf u_rf(
+    .clock(clock),
+    .reset(reset),
+
+    .wen   (rf_wen),
+    .wdata (rf_wdata),
+    .rd    (wb_rd),
+    .rs1   (id_rs1),
+    .rs2   (id_rs2),
+    .rdata1(rf_rdata1),
+    .rdata2(rf_rdata2));
+
+  assign is_id_rs1 = !(id_inst_type == INST_UPP || id_inst_type == INST_AUIPC || id_inst_type == INST_JUMP ||
+                       id_inst_type[5:3] == INST_SYSTEM);
+  assign is_id_rs2 = id_inst_type == INST_REG || id_inst_type == INST_BRANCH || id_inst_type[5:3] == INST_STORE;
+
+  assign id_rdata1 = is_forward(wb_valid, wb_inst_type, wb_rd, id_rs1) ? rf_wdata : rf_rdata1;
+  assign id_rdata2 = is_forward(wb_valid, wb_inst_type, wb_rd, id_rs2) ? rf_wdata : rf_rdata2;
+
+  assign is_hazard =
+    (ex_valid && is_late(ex_inst_type) && ex_rd != 0 &&
+     ((is_id_rs1 && ex_rd == id_rs1) || (is_id_rs2 && ex_rd == id_rs2))) ||
+    (mem_valid && is_csr(mem_inst_type) && mem_rd != 0 &&
+     ((is_id_rs1 && mem_rd == id_rs1) || (is_id_rs2 && mem_rd == id_rs2)));
+
+  assign is_ex_ready = !ex_valid || is_ex_advance;
+  assign is_id_issue = id_valid && !is_halted && !is_hazard && is_ex_ready && !is_redirect;
+
+  // NOTE: nothing after an ebreak is issued, the testbench stops on it
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      is_halted <= 1'b0;
+    end
+    else if (is_id_issue && id_inst_type == INST_EBREAK) begin
+      is_halted <= 1'b1;
+    end
+  end
+
+  // ---------------------------------------------------------------- EX
+
+  assign ex_rdata1 = is_forward(mem_valid, mem_inst_type, mem_rd, ex_rs1) ? mem_forward :
+                     is_forward(wb_valid,  wb_inst_type,  wb_rd,  ex_rs1) ? rf_wdata    : ex_rdata1_q;
+  assign ex_rdata2 = is_forward(mem_valid, mem_inst_type, mem_rd, ex_rs2) ? mem_forward :
+                     is_forward(wb_valid,  wb_inst_type,  wb_rd,  ex_rs2) ? rf_wdata    : ex_rdata2_q;
+
+  // NOTE: a stalled instruction keeps its forwarded operands, WB retires under it
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      ex_valid <= 1'b0;
+    end
+    else if (is_id_issue) begin
+      ex_valid     <= 1'b1;
+      ex_pc        <= id_pc;
+      ex_pred_pc   <= id_pred_pc;
+      ex_rd        <= id_rd;
+      ex_rs1       <= id_rs1;
+      ex_rs2       <= id_rs2;
+      ex_rdata1_q  <= id_rdata1;
+      ex_rdata2_q  <= id_rdata2;
+      ex_inst_type <= id_inst_type;
+      ex_imm       <= id_imm;
+      ex_alu_op    <= id_alu_op;
+      ex_com_op    <= id_com_op;
+      ex_is_rvc    <= id_is_rvc;
+    end
+    else if (is_ex_advance) begin
+      ex_valid <= 1'b0;
+    end
+    else if (ex_valid) begin
+      ex_rdata1_q <= ex_rdata1;
+      ex_rdata2_q <= ex_rdata2;
+    end
+  end
+
+  exu_pipe u_exu(
+    .clock(clock),
+    .reset(reset),
+
+    .rdata1(ex_rdata1),
+    .rdata2(ex_rdata2),
+    .pc    (ex_pc),
+    .is_rvc(ex_is_rvc),
+
+    .is_pc_jump    (ex_is_pc_jump),
+    .is_branch_true(ex_is_branch_true),
+    .pc_next       (ex_pc_next),
+    .result        (ex_result),
+    .lsu_addr      (ex_lsu_addr),
+
+    .is_ebreak(wb_valid && wb_inst_type == INST_EBREAK),
+
+    .div_reqValid (ex_div_reqValid),
+    .div_respValid(ex_div_respValid),
+
+    .alu_op   (ex_alu_op),
+    .com_op   (ex_com_op),
+    .imm      (ex_imm),
+    .inst_type(ex_inst_type));
+
+  // NOTE: the division latches its operands with the request, so it waits in EX while one of them
+  // is forwarded from a load in MEM not answered yet (lsu_rdata is stale before lsu_respValid);
+  // is_ex_div_req is kept until the request goes. Its answer is a pulse, kept in is_ex_div_done
+  // while MEM is not ready
+  assign is_ex_load_wait = mem_valid && mem_inst_type[5:3] == INST_LOAD && !lsu_respValid &&
+                           (is_forward(mem_valid, mem_inst_type, mem_rd, ex_rs1) ||
+                            is_forward(mem_valid, mem_inst_type, mem_rd, ex_rs2));
+  assign ex_div_reqValid = is_ex_div_req && !is_ex_load_wait;
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      is_ex_div_req  <= 1'b0;
+      is_ex_div_done <= 1'b0;
+    end
+    else begin
+      is_ex_div_req  <= is_id_issue ? is_div(id_inst_type, id_alu_op) : is_ex_div_req && !ex_div_reqValid;
+      is_ex_div_done <= !is_ex_advance && (is_ex_div_done || ex_div_respValid);
+    end
+  end
+
+  assign is_ex_advance = ex_valid && is_mem_ready &&
+                         (!is_div(ex_inst_type, ex_alu_op) || ex_div_respValid || is_ex_div_done);
+  assign is_redirect   = is_ex_advance && ex_pc_next != ex_pred_pc;
+  assign is_bpu_update = is_ex_advance && (ex_inst_type == INST_BRANCH || ex_inst_type == INST_JUMP || ex_inst_type == INST_JUMPR);
+
+  // ---------------------------------------------------------------- MEM
+
+  assign is_mem_lsu     = mem_inst_type[4];
+  assign is_mem_done    = !is_mem_lsu || lsu_respValid;
+  assign is_mem_advance = mem_valid && is_mem_done;
+  assign is_mem_ready   = !mem_valid || is_mem_advance;
+  assign mem_forward    = mem_inst_type[5:3] == INST_LOAD ? lsu_rdata : mem_result;
+
+  assign is_store = mem_inst_type[5:3] == INST_STORE;
+
+  // NOTE: lsu_reqValid is a registered pulse, like the one of the multicycle core. It waits one more
+  // cycle after an answer: the LSU holds its bus request for a cycle, which may get answered twice.
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      mem_valid     <= 1'b0;
+      is_mem_issued <= 1'b0;
+      lsu_reqValid  <= 1'b0;
+    end
+    else begin
+      lsu_reqValid <= !lsu_respValid &&
+                      (is_ex_advance ? ex_inst_type[4]
+                                     : mem_valid && !is_mem_advance && is_mem_lsu && !is_mem_issued && !lsu_reqValid);
+      if (is_ex_advance) begin
+        mem_valid          <= 1'b1;
+        is_mem_issued      <= 1'b0;
+        mem_rd             <= ex_rd;
+        mem_inst_type      <= ex_inst_type;
+        mem_csr_addr       <= ex_imm[11:0];
+        mem_result         <= ex_result;
+        mem_pc_next        <= ex_pc_next;
+        mem_is_branch_true <= ex_is_branch_true;
+        lsu_addr           <= ex_lsu_addr;
+        lsu_wdata          <= ex_rdata2;
+      end
+      else if (is_mem_advance) begin
+        mem_valid <= 1'b0;
+      end
+      else if (lsu_reqValid) begin
+        is_mem_issued <= 1'b1;
+      end
+    end
+  end
+
+  lsu u_lsu(
+    .clock(clock),
+    .reset(reset),
+
+    .reqValid     (lsu_reqValid),
+    .respValid    (lsu_respValid),
+    .is_write     (is_store),
+    .wdata        (lsu_wdata),
+    .rdata        (lsu_rdata),
+    .addr         (lsu_addr),
+    .data_size    (mem_inst_type[1:0]),
+    .is_mem_sign  (!mem_inst_type[2]),
+
+    .io_respValid (io_lsu_respValid),
+    .io_reqValid  (io_lsu_reqValid),
+    .io_wdata     (io_lsu_wdata),
+    .io_rdata     (io_lsu_rdata),
+    .io_addr      (io_lsu_addr),
+    .io_size      (io_lsu_size),
+    .io_wen       (io_lsu_wen),
+    .io_wmask     (io_lsu_wmask),
+
+    .is_busy            (lsu_is_busy),
+    .is_dcache_hit      (lsu_dcache_hit),
+    .is_dcache_miss     (lsu_dcache_miss),
+    .is_dcache_writeback(lsu_dcache_writeback));
+
+  // ---------------------------------------------------------------- WB
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      wb_valid <= 1'b0;
+    end
+    else begin
+      wb_valid <= is_mem_advance;
+      if (is_mem_advance) begin
+        wb_rd             <= mem_rd;
+        wb_inst_type      <= mem_inst_type;
+        wb_csr_addr       <= mem_csr_addr;
+        wb_result         <= mem_forward;
+        wb_pc_next        <= mem_pc_next;
+        wb_is_branch_true <= mem_is_branch_true;
+      end
+    end
+  end
+
+  // NOTE: csr reads happen at the retirement, minstret counts the instructions before
+  assign rf_wdata = is_csr(wb_inst_type) ? csr_rdata : wb_result;
+  assign rf_wen   = wb_valid && wb_inst_type[3];
+  assign pc_wen   = wb_valid;
+
+  always_comb begin
+    perf_events                         = 0;
+    perf_events[PERF_IFU_WAIT]          = !id_valid && !is_halted;
+    perf_events[PERF_LSU_WAIT]          = mem_valid && is_mem_lsu && !lsu_respValid;
+    perf_events[PERF_LOAD]              = wb_valid && wb_inst_type[5:3] == INST_LOAD;
+    perf_events[PERF_STORE]             = wb_valid && wb_inst_type[5:3] == INST_STORE;
+    perf_events[PERF_SYSTEM]            = wb_valid && wb_inst_type[5:3] == INST_SYSTEM;
+    perf_events[PERF_CALC]              = wb_valid && wb_inst_type[5:4] == INST_EXEC && wb_inst_type[0] == INST_CALC;
+    perf_events[PERF_JUMP]              = wb_valid && (wb_inst_type == INST_JUMP || wb_inst_type == INST_JUMPR);
+    perf_events[PERF_BRANCH]            = wb_valid && wb_inst_type == INST_BRANCH;
+    perf_events[PERF_BRANCH_TAKEN]      = wb_valid && wb_is_branch_true;
+    perf_events[PERF_ICACHE_HIT]        = ifu_icache_hit;
+    perf_events[PERF_ICACHE_MISS]       = ifu_icache_miss;
+    perf_events[PERF_ICACHE_REFILL]     = ifu_icache_refill;
+    perf_events[PERF_BRANCH_MISPREDICT] = is_redirect;
+    perf_events[PERF_BTB_HIT]           = is_fetch_keep && bpu_is_btb_hit;
+    perf_events[PERF_DCACHE_HIT]        = lsu_dcache_hit;
+    perf_events[PERF_DCACHE_MISS]       = lsu_dcache_miss;
+    perf_events[PERF_DCACHE_WRITEBACK]  = lsu_dcache_writeback;
+    perf_events[PERF_PREFETCH_USEFUL]   = ifu_prefetch_useful;
+    perf_events[PERF_PREFETCH_USELESS]  = ifu_prefetch_useless;
+  end
+
+  csr u_csr(
+    .clock(clock),
+    .reset(reset),
+    .instret    ({1'b0, wb_valid}),
+    .perf_events(perf_events),
+    .addr (wb_csr_addr),
+    .rdata(csr_rdata));
+
+`ifdef verilator
+/* verilator lint_off UNUSEDSIGNAL */
+reg [119:0] dbg_inst;
+always @ * begin
+  case (id_inst_type)
+    INST_EBREAK   : dbg_inst = "INST_EBREAK";
+    INST_CSR      : dbg_inst = "INST_CSR";
+    INST_CSRI     : dbg_inst = "INST_CSRI";
+
+    INST_LOAD_B  : dbg_inst = "INST_LOAD_B";
+    INST_LOAD_H  : dbg_inst = "INST_LOAD_H";
+    INST_LOAD_W  : dbg_inst = "INST_LOAD_W";
+    INST_LOAD_BU : dbg_inst = "INST_LOAD_BU";
+    INST_LOAD_HU : dbg_inst = "INST_LOAD_HU";
+    INST_STORE_B : dbg_inst = "INST_STORE_B";
+    INST_STORE_H : dbg_inst = "INST_STORE_H";
+    INST_STORE_W : dbg_inst = "INST_STORE_W";
+
+    INST_BRANCH     : dbg_inst = "INST_BRANCH";
+    INST_IMM        : dbg_inst = "INST_IMM";
+    INST_REG        : dbg_inst = "INST_REG";
+    INST_UPP        : dbg_inst = "INST_UPP";
+    INST_JUMP       : dbg_inst = "INST_JUMP";
+    INST_JUMPR      : dbg_inst = "INST_JUMPR";
+    INST_AUIPC      : dbg_inst = "INST_AUIPC";
+    default         : dbg_inst = "INST_UNDEFINED";
+  endcase
+end
+
+/* verilator lint_on UNUSEDSIGNAL */
+`endif
+
+endmodule
+`endif
@@ -1,41 +1,92 @@
 module csr (
-  input  logic               clock,
-  input  logic               reset,
-  input  logic [11:0]        addr,
-  output logic [REG_W_END:0] rdata);
+  input  logic                     clock,
+  input  logic                     reset,
+  input  logic [1:0]               instret, // 2 for a fused pair
+  input  logic [PERF_EVENTS_END:0] perf_events,
+  input  logic [11:0]              addr,
+  output logic [REG_W_END:0]       rdata);
 
 /* verilator lint_off UNUSEDPARAM */
 `include "reg_defines.vh"
+`include "perf_defines.vh"
 /* verilator lint_on UNUSEDPARAM */
 
   localparam MCYCLE        = 12'hB00;
   localparam MCYCLEH        = 12'hB80;
+  localparam MINSTRET      = 12'hB02;
+  localparam MINSTRETH     = 12'hB82;
+  localparam MHPMCOUNTER3  = 12'hB03;
+  localparam MHPMCOUNTER3H = 12'hB83;
   localparam MVENDORID     = 12'hf11;
   localparam MARCHID       = 12'hf12;
 
   localparam MVENDORID_VAL = "akeb";
   localparam MARCHID_VAL   = 32'h05318008; 
 
-  logic [63:0] mcycle;
+  localparam HPM_N = PERF_EVENTS_END + 1;
+  localparam [11:0] HPM_LAST = 12'(PERF_EVENTS_END);
+  localparam HPM_W = $clog2(HPM_N);
+
+  // NOTE: the testbench reads the counters directly, no DPI call per cycle; the idle skip writes them,
+  // only in the vcpu built with IDLE_SKIP=1
+`ifdef IDLE_SKIP
+  logic [63:0] mcycle                     /* verilator public_flat_rw @(posedge clock) */;
+  logic [63:0] minstret                   /* verilator public_flat_rw @(posedge clock) */;
+  logic [63:0] mhpmcounter [0:HPM_N-1]    /* verilator public_flat_rw @(posedge clock) */;
+`else
+  logic [63:0] mcycle                     /* verilator public_flat_rd */;
+  logic [63:0] minstret                   /* verilator public_flat_rd */;
+  logic [63:0] mhpmcounter [0:HPM_N-1]    /* verilator public_flat_rd */;
+`endif
 
   always_ff @(posedge clock or posedge reset) begin
     if (reset) begin
-      mcycle <= 64'h0;
+      mcycle   <= 64'h0;
+      minstret <= 64'h0;
     end
     else begin
-      mcycle <= mcycle + 1;
+      mcycle   <= mcycle + 1;
+      minstret <= minstret + {62'h0, instret};
     end
   end
 
+  generate
+    for (genvar i = 0; i < HPM_N; i++) begin : gen_hpm_ff
+      always_ff @(posedge clock or posedge reset) begin
+        if (reset) begin
+          mhpmcounter[i] <= 64'h0;
+        end
+        else begin
+          mhpmcounter[i] <= mhpmcounter[i] + {63'h0, perf_events[i]};
+        end
+      end
+    end
+  endgenerate
+
+  // NOTE: mhpmcounter3 and up, the counters past the last event read as 0
+  logic [11:0] hpm_index;
+  logic [11:0] hpmh_index;
+  assign hpm_index  = addr - MHPMCOUNTER3;
+  assign hpmh_index = addr - MHPMCOUNTER3H;
+
   always_comb begin
     case (addr) 
       MARCHID:   rdata = MARCHID_VAL;
       MVENDORID: rdata = MVENDORID_VAL;
       MCYCLE:    rdata = mcycle[31: 0];
       MCYCLEH:   rdata = mcycle[63:32];
-      default:   rdata = 32'h0;
+      MINSTRET:  rdata = minstret[31: 0];
+      MINSTRETH: rdata = minstret[63:32];
+      default: begin
+        rdata = 32'h0;
+        if (hpm_index <= HPM_LAST) begin
+          rdata = mhpmcounter[hpm_index[HPM_W-1:0]][31: 0];
+        end
+        else if (hpmh_index <= HPM_LAST) begin
+          rdata = mhpmcounter[hpmh_index[HPM_W-1:0]][63:32];
+        end
+      end
     endcase
   end
 
 endmodule
-
@@ -0,0 +1,316 @@
+module dcache #(
+  parameter WAYS       = 2, // 2 or more
+  parameter SETS       = 16,
+  parameter LINE_WORDS = 4, // 2 or more
+  parameter [31:0] START = 32'h8000_0000,
+  parameter [31:0] END   = 32'h8200_0000
+) (
+  input  logic        clock,
+  input  logic        reset,
+
+  // NOTE: the bus port of the lsu, a request is high in its first cycle and held one more
+  input  logic        reqValid,
+  output logic        respValid,
+  input  logic [31:0] addr,
+  input  logic [1:0]  size,
+  input  logic        wen,
+  input  logic [31:0] wdata,
+  input  logic [3:0]  wmask,
+  output logic [31:0] rdata,
+
+  output logic        io_reqValid,
+  input  logic        io_respValid,
+  output logic [31:0] io_addr,
+  output logic [1:0]  io_size,
+  output logic        io_wen,
+  output logic [31:0] io_wdata,
+  output logic [3:0]  io_wmask,
+  input  logic [31:0] io_rdata,
+
+  output logic        is_busy,
+  output logic        is_hit,
+  output logic        is_miss,
+  output logic        is_writeback);
+
+  localparam m = $clog2(LINE_WORDS);
+  localparam n = $clog2(SETS);
+  localparam TAG_W = 30-m-n;
+  localparam WAY_W = $clog2(WAYS);
+
+/*
+      DCACHE, WAYS x SETS
+  +---+---+-----+----------------------+
+  | 1 | 1 |TAG_W| 32 x LINE_WORDS      |
+  +---+---+-----+----------------------+
+  | v | d | tag | word 0 | ... | word N|
+  +---+---+-----+----------------------+
+  |   |   |     |                      | x SETS
+  +---+---+-----+----------------------+
+*/
+
+  // NOTE: the testbench reads the lines and the store buffer to compare the memory as the core sees it
+  logic             valid [0:WAYS-1][0:SETS-1]                 /* verilator public_flat_rd */;
+  logic             dirty [0:WAYS-1][0:SETS-1];
+  logic [TAG_W-1:0] tags  [0:WAYS-1][0:SETS-1]                 /* verilator public_flat_rd */;
+  logic [31:0]      data  [0:WAYS-1][0:SETS-1][0:LINE_WORDS-1] /* verilator public_flat_rd */;
+  logic [WAY_W-1:0] repl  [0:SETS-1]; // round robin victim of the set
+
+  logic [TAG_W-1:0] tag;
+  logic [    n-1:0] index;
+  logic [    m-1:0] offset;
+  assign tag    = addr[   31:2+m+n];
+  assign index  = addr[m+n+1:  2+m];
+  assign offset = addr[  m+1:    2];
+
+  // NOTE: the missed access, a store is answered at once and waits here (store buffer) until its line is in
+  logic             op_valid /* verilator public_flat_rd */;
+  logic [31:2]      op_addr  /* verilator public_flat_rd */;
+  logic [31:0]      op_wdata /* verilator public_flat_rd */;
+  logic [3:0]       op_wmask /* verilator public_flat_rd */;
+  logic             op_wen;
+  logic [WAY_W-1:0] op_way;
+
+  logic [TAG_W-1:0] op_tag;
+  logic [    n-1:0] op_index;
+  logic [    m-1:0] op_offset;
+  assign op_tag    = op_addr[   31:2+m+n];
+  assign op_index  = op_addr[m+n+1:  2+m];
+  assign op_offset = op_addr[  m+1:    2];
+
+  logic             is_cached;
+  logic             is_way_hit;
+  logic [WAY_W-1:0] hit_way;
+  logic [WAY_W-1:0] victim;
+  logic             is_dup;
+  logic             is_req;
+  logic             is_pending;
+  logic             is_bus_req;
+  logic [m-1:0]     word;
+  logic             is_last_word;
+  logic             is_accept_q;
+  logic [31:0]      accept_addr_q;
+  logic             accept_wen_q;
+
+  assign is_cached    = addr >= START && addr < END;
+  assign victim       = repl[index];
+  assign is_last_word = word == m'(LINE_WORDS - 1);
+
+  always_comb begin
+    is_way_hit = 1'b0;
+    hit_way    = '0;
+    for (int w = 0; w < WAYS; w++) begin
+      if (valid[w][index] && tags[w][index] == tag) begin
+        is_way_hit = 1'b1;
+        hit_way    = WAY_W'(w);
+      end
+    end
+  end
+
+  // NOTE: the lsu holds a request one cycle more, a request taken in IDLE in its first cycle comes again,
+  // whether it was answered (hit, store, bus) or not (read miss); a request that came while busy is
+  // in is_pending, its copy too
+  assign is_dup = is_accept_q && addr == accept_addr_q && wen == accept_wen_q;
+  assign is_req = (reqValid && !is_dup) || is_pending;
+
+  typedef enum logic [2:0] {
+    DCACHE_IDLE, DCACHE_PASS, DCACHE_WRITEBACK, DCACHE_REFILL, DCACHE_STORE, DCACHE_RESP
+  } dcache_state;
+
+  dcache_state next_state;
+  dcache_state curr_state;
+
+  assign is_busy = curr_state != DCACHE_IDLE;
+
+  always_comb begin
+    next_state   = curr_state;
+    respValid    = 1'b0;
+    rdata        = data[hit_way][index][offset];
+    io_reqValid  = 1'b0;
+    io_addr      = addr;
+    io_size      = size;
+    io_wen       = wen;
+    io_wdata     = wdata;
+    io_wmask     = wmask;
+    is_hit       = 1'b0;
+    is_miss      = 1'b0;
+    is_writeback = 1'b0;
+    case (curr_state)
+      DCACHE_IDLE: begin
+        if (is_req && !is_cached) begin
+          // NOTE: uart, flash and the other devices go to the bus as the lsu sends them;
+          // a request that came while busy is sent again from PASS
+          if (is_pending) begin
+            next_state = DCACHE_PASS;
+          end
+          else begin
+            io_reqValid = 1'b1;
+            respValid   = io_respValid;
+            rdata       = io_rdata;
+            next_state  = io_respValid ? DCACHE_IDLE : DCACHE_PASS;
+          end
+        end
+        else if (is_req && is_way_hit) begin
+          is_hit    = 1'b1;
+          respValid = 1'b1;
+        end
+        else if (is_req) begin
+          is_miss    = 1'b1;
+          respValid  = wen;
+          next_state = valid[victim][index] && dirty[victim][index] ? DCACHE_WRITEBACK : DCACHE_REFILL;
+        end
+      end
+      DCACHE_PASS: begin
+        io_reqValid = reqValid || is_bus_req;
+        respValid   = io_respValid;
+        rdata       = io_rdata;
+        if (io_respValid) begin
+          next_state = DCACHE_IDLE;
+        end
+      end
+      DCACHE_WRITEBACK: begin
+        io_reqValid = is_bus_req;
+        io_addr     = {tags[op_way][op_index], op_index, word, 2'b00};
+        io_size     = 2'b10;
+        io_wen      = 1'b1;
+        io_wdata    = data[op_way][op_index][word];
+        io_wmask    = 4'b1111;
+        if (io_respValid && is_last_word) begin
+          is_writeback = 1'b1;
+          next_state   = DCACHE_REFILL;
+        end
+      end
+      DCACHE_REFILL: begin
+        io_reqValid = is_bus_req;
+        io_addr     = {op_tag, op_index, word, 2'b00};
+        io_size     = 2'b10;
+        io_wen      = 1'b0;
+        io_wmask    = 4'b1111;
+        if (io_respValid && is_last_word) begin
+          next_state = op_wen ? DCACHE_STORE : DCACHE_RESP;
+        end
+      end
+      DCACHE_STORE: begin
+        next_state = DCACHE_IDLE;
+      end
+      DCACHE_RESP: begin
+        respValid  = 1'b1;
+        rdata      = data[op_way][op_index][op_offset];
+        next_state = DCACHE_IDLE;
+      end
+      default: begin
+        next_state = DCACHE_IDLE;
+      end
+    endcase
+  end
+
+  // NOTE: the bus requests of the dcache are registered pulses, one per word
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      curr_state  <= DCACHE_IDLE;
+      is_pending  <= 1'b0;
+      is_bus_req  <= 1'b0;
+      is_accept_q <= 1'b0;
+      op_valid    <= 1'b0;
+      word        <= '0;
+      for (int w = 0; w < WAYS; w++) begin
+        for (int s = 0; s < SETS; s++) begin
+          valid[w][s] <= 1'b0;
+        end
+      end
+      for (int s = 0; s < SETS; s++) begin
+        repl[s] <= '0;
+      end
+    end
+    else begin
+      curr_state  <= next_state;
+      is_accept_q   <= curr_state == DCACHE_IDLE && reqValid && !is_dup && !is_pending;
+      accept_addr_q <= addr;
+      accept_wen_q  <= wen;
+      is_pending  <= curr_state != DCACHE_IDLE && curr_state != DCACHE_PASS &&
+                     (is_pending || (reqValid && !is_dup));
+      is_bus_req  <= (next_state == DCACHE_PASS && is_pending) ||
+                     (curr_state == DCACHE_IDLE && (next_state == DCACHE_WRITEBACK || next_state == DCACHE_REFILL)) ||
+                     (curr_state == DCACHE_WRITEBACK && io_respValid) ||
+                     (curr_state == DCACHE_REFILL && io_respValid && !is_last_word);
+      case (curr_state)
+        DCACHE_IDLE: begin
+          if (is_req && is_way_hit && wen) begin
+            dirty[hit_way][index] <= 1'b1;
+          end
+          else if (is_req && is_cached && !is_way_hit) begin
+            op_valid <= wen;
+            op_addr  <= addr[31:2];
+            op_wdata <= wdata;
+            op_wmask <= wmask;
+            op_wen   <= wen;
+            op_way   <= victim;
+            word     <= '0;
+            if (!(valid[victim][index] && dirty[victim][index])) begin
+              valid[victim][index] <= 1'b0;
+              tags [victim][index] <= tag;
+            end
+          end
+        end
+        DCACHE_WRITEBACK: begin
+          if (io_respValid) begin
+            word <= word + 1'b1;
+          end
+          if (io_respValid && is_last_word) begin
+            valid[op_way][op_index] <= 1'b0;
+            tags [op_way][op_index] <= op_tag;
+          end
+        end
+        DCACHE_REFILL: begin
+          if (io_respValid) begin
+            word <= word + 1'b1;
+          end
+          if (io_respValid && is_last_word) begin
+            valid[op_way][op_index] <= 1'b1;
+            dirty[op_way][op_index] <= 1'b0;
+            repl [op_index]         <= op_way + 1'b1;
+          end
+        end
+        DCACHE_STORE: begin
+          dirty[op_way][op_index] <= 1'b1;
+          op_valid                <= 1'b0;
+        end
+        default: begin
+        end
+      endcase
+    end
+  end
+
+  always_ff @(posedge clock) begin
+    if (curr_state == DCACHE_IDLE && is_req && is_way_hit && wen) begin
+      for (int b = 0; b < 4; b++) begin
+        if (wmask[b]) data[hit_way][index][offset][b*8 +: 8] <= wdata[b*8 +: 8];
+      end
+    end
+    else if (curr_state == DCACHE_REFILL && io_respValid) begin
+      data[op_way][op_index][word] <= io_rdata;
+    end
+    else if (curr_state == DCACHE_STORE) begin
+      for (int b = 0; b < 4; b++) begin
+        if (op_wmask[b]) data[op_way][op_index][op_offset][b*8 +: 8] <= op_wdata[b*8 +: 8];
+      end
+    end
+  end
+
+`ifdef verilator
+/* verilator lint_off UNUSEDSIGNAL */
+reg [127:0]  dbg_dcache;
+
+always @ * begin
+  case (curr_state)
+    DCACHE_IDLE      : dbg_dcache = "DCACHE_IDLE";
+    DCACHE_PASS      : dbg_dcache = "DCACHE_PASS";
+    DCACHE_WRITEBACK : dbg_dcache = "DCACHE_WRITEBACK";
+    DCACHE_REFILL    : dbg_dcache = "DCACHE_REFILL";
+    DCACHE_STORE     : dbg_dcache = "DCACHE_STORE";
+    DCACHE_RESP      : dbg_dcache = "DCACHE_RESP";
+    default          : dbg_dcache = "DCACHE_UNDEFINED";
+  endcase
+end
+/* verilator lint_on UNUSEDSIGNAL */
+`endif
+endmodule
@@ -0,0 +1,7 @@
+// geometry of the dcache (DCACHE=1 ./build_run.sh), powers of 2: 2 or more ways, lines of 2 or more words
+localparam DCACHE_WAYS       = 2;
+localparam DCACHE_SETS       = 16;
+localparam DCACHE_LINE_WORDS = 4;
+// NOTE: the cached range is the memory of mem_map.h, the uart, flash and other devices are not cached
+localparam [31:0] DCACHE_START = 32'h8000_0000;
+localparam [31:0] DCACHE_END   = 32'h8200_0000;
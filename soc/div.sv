@@ -0,0 +1,76 @@
+// NOTE: the iterative divider of the M extension (div, divu, rem, remu), one quotient bit per cycle.
+// The answer comes 33 cycles after the request whatever the operands: the division by zero and
+// the overflow give the RISC-V results without an early exit, so a loop keeps the same cycle counts.
+module div (
+  input  logic               clock,
+  input  logic               reset,
+
+  input  logic               reqValid,
+  output logic               respValid,
+
+  input  logic [1:0]         op, // funct3[1:0]
+  input  logic [REG_W_END:0] lhs,
+  input  logic [REG_W_END:0] rhs,
+  output logic [REG_W_END:0] res);
+
+/* verilator lint_off UNUSEDPARAM */
+`include "reg_defines.vh"
+/* verilator lint_on UNUSEDPARAM */
+
+  logic        is_busy;
+  logic [5:0]  count;
+  logic        is_rem;
+  logic        is_neg_quo;
+  logic        is_neg_rem;
+  logic [31:0] divisor;
+  logic [31:0] quo;
+  logic [31:0] rem;
+  logic [32:0] rem_shift;
+  logic        is_signed;
+  logic        is_lhs_neg;
+  logic        is_rhs_neg;
+
+  // NOTE: op[0] is the unsigned one, op[1] the remainder: DIV 00, DIVU 01, REM 10, REMU 11
+  assign is_signed  = !op[0];
+  assign is_lhs_neg = is_signed && lhs[31];
+  assign is_rhs_neg = is_signed && rhs[31];
+  assign rem_shift  = {rem, quo[31]};
+
+  assign respValid = is_busy && count == 0;
+  always_comb begin
+    if (is_rem) res = is_neg_rem ? -rem : rem;
+    else        res = is_neg_quo ? -quo : quo;
+  end
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      is_busy <= 1'b0;
+      count   <= '0;
+    end
+    else if (reqValid) begin
+      is_busy    <= 1'b1;
+      count      <= 6'd32;
+      is_rem     <= op[1];
+      is_neg_quo <= (is_lhs_neg ^ is_rhs_neg) && rhs != 0;
+      is_neg_rem <= is_lhs_neg;
+      divisor    <= is_rhs_neg ? -rhs : rhs;
+      quo        <= is_lhs_neg ? -lhs : lhs;
+      rem        <= '0;
+    end
+    else if (is_busy && count != 0) begin
+      count <= count - 1'b1;
+      if (rem_shift >= {1'b0, divisor}) begin
+        rem <= 32'(rem_shift - {1'b0, divisor});
+        quo <= {quo[30:0], 1'b1};
+      end
+      else begin
+        rem <= rem_shift[31:0];
+        quo <= {quo[30:0], 1'b0};
+      end
+    end
+    else begin
+      is_busy <= 1'b0;
+    end
+  end
+
+endmodule
@@ -0,0 +1,85 @@
+// NOTE: memory port backed by the testbench memory through DPI, for the standalone cpu build.
+// A request is sampled on every posedge where reqValid is high and replaces the pending one
+// (the LSU keeps reqValid high for one more cycle after its request), the response is
+// registered and presented for one cycle LATENCY cycles after the request cycle + 1.
+// LATENCY 0 is a zero-wait synchronous memory.
+// With IS_HELD (the LSU port) a request comes again on the posedge after the one that took it, answered or
+// not; like in dcache.sv that copy is dropped, so a store is done once and the latency is not restarted.
+// A new request never comes right after the one taken.
+module dpi_mem #(
+  parameter LATENCY = 0,
+  parameter IS_HELD = 0
+) (
+  input  logic        clock,
+  input  logic        reset,
+
+  input  logic        reqValid,
+  input  logic [31:0] addr,
+  input  logic        wen,
+  input  logic [31:0] wdata,
+  input  logic [3:0]  wmask,
+  output logic        respValid,
+  output logic [31:0] rdata);
+
+import "DPI-C" function int  dpi_mem_read(input int addr);
+import "DPI-C" function void dpi_mem_write(input int addr, input int wdata, input byte wmask);
+
+  logic        pending;
+  logic [31:0] wait_cycles;
+  logic [31:0] addr_q;
+  logic        wen_q;
+  logic [31:0] wdata_q;
+  logic [3:0]  wmask_q;
+  logic        is_accept_q;
+  logic [31:0] accept_addr_q;
+  logic        accept_wen_q;
+  logic        is_dup;
+
+  assign is_dup = IS_HELD != 0 && is_accept_q && addr == accept_addr_q && wen == accept_wen_q;
+
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      pending     <= 1'b0;
+      wait_cycles <= 32'b0;
+      addr_q      <= 32'b0;
+      wen_q       <= 1'b0;
+      wdata_q     <= 32'b0;
+      wmask_q     <= 4'b0;
+      is_accept_q   <= 1'b0;
+      accept_addr_q <= 32'b0;
+      accept_wen_q  <= 1'b0;
+      respValid   <= 1'b0;
+      rdata       <= 32'b0;
+    end
+    else begin
+      respValid     <= 1'b0;
+      is_accept_q   <= reqValid && !is_dup;
+      accept_addr_q <= addr;
+      accept_wen_q  <= wen;
+      if (reqValid && !is_dup && LATENCY == 0) begin
+        pending <= 1'b0;
+        if (wen) dpi_mem_write(addr, wdata, {4'b0, wmask});
+        rdata       <= dpi_mem_read(addr);
+        respValid   <= 1'b1;
+      end
+      else if (reqValid && !is_dup) begin
+        pending     <= 1'b1;
+        wait_cycles <= LATENCY - 1;
+        addr_q      <= addr;
+        wen_q       <= wen;
+        wdata_q     <= wdata;
+        wmask_q     <= wmask;
+      end
+      else if (pending && wait_cycles == 0) begin
+        pending <= 1'b0;
+        if (wen_q) dpi_mem_write(addr_q, wdata_q, {4'b0, wmask_q});
+        rdata       <= dpi_mem_read(addr_q);
+        respValid   <= 1'b1;
+      end
+      else if (pending) begin
+        wait_cycles <= wait_cycles - 1;
+      end
+    end
+  end
+
+endmodule
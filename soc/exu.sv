@@ -20,6 +20,10 @@ module exu (
   output logic [REG_W_END:0] rf_wdata,
   output logic [REG_W_END:0] lsu_addr,
   output logic [REG_W_END:0] lsu_wdata,
+  output logic [REG_W_END:0] alu_res,   // the value of a fused head, see cpu.sv
+
+  output logic                  is_instret,
+  output logic [PERF_EXU_END:0] perf_events,
 
   input  logic [ALU_OP_END:0]    alu_op,
   input  logic [COM_OP_END:0]    com_op,
@@ -31,13 +35,17 @@ module exu (
 `include "reg_defines.vh"
 `include "alu_defines.vh"
 `include "inst_defines.vh"
+`include "perf_defines.vh"
 /* verilator lint_on UNUSEDPARAM */
 
   logic is_jump;
   logic is_branch;
   logic is_branch_true;
+  logic is_div;
+  logic div_respValid;
+  logic [REG_W_END:0] div_res;
 
-  typedef enum logic [2:0] { EXU_START, EXU_RESET, EXU_EXECUTE, EXU_STALL_IDU, EXU_STALL_LSU } cpu_state;
+  typedef enum logic [2:0] { EXU_START, EXU_RESET, EXU_EXECUTE, EXU_STALL_IDU, EXU_STALL_LSU, EXU_STALL_DIV } cpu_state;
 
   cpu_state next_state;
   cpu_state curr_state;
@@ -51,12 +59,15 @@ module exu (
     end
   end
 
-  assign lsu_or_exec = is_lsu_inst && ~lsu_respValid ? EXU_STALL_LSU : EXU_EXECUTE;
+  // NOTE: a division waits for div.sv, its answer never comes in the request cycle
+  assign lsu_or_exec = is_lsu_inst && ~lsu_respValid ? EXU_STALL_LSU :
+                       is_div                        ? EXU_STALL_DIV : EXU_EXECUTE;
   assign respValid   = next_state == EXU_EXECUTE;
 
   assign is_jump         = (inst_type == INST_JUMP) | (inst_type == INST_JUMPR);
   assign is_branch       = inst_type == INST_BRANCH;
   assign is_branch_true  = is_branch & com_res;
+  assign is_div          = inst_type == INST_REG && alu_op[4] && alu_op[2];
 
   assign is_pc_jump = is_jump | is_branch_true;
   assign pc_jump    = alu_res;
@@ -93,6 +104,14 @@ module exu (
           next_state = EXU_STALL_LSU;
         end
       end
+      EXU_STALL_DIV: begin
+        if (div_respValid) begin
+          next_state = EXU_EXECUTE;
+        end
+        else begin
+          next_state = EXU_STALL_DIV;
+        end
+      end
       EXU_EXECUTE: begin
         next_state = EXU_STALL_IDU;
         if (reqValid) begin
@@ -104,7 +123,6 @@ module exu (
 
   logic [REG_W_END:0] alu_lhs;
   logic [REG_W_END:0] alu_rhs;
-  logic [REG_W_END:0] alu_res;
   logic               com_res;
 
   alu u_alu(
@@ -119,6 +137,16 @@ module exu (
     .rhs(rdata2),
     .res(com_res));
 
+  div u_div(
+    .clock    (clock),
+    .reset    (reset),
+    .reqValid (reqValid && is_div),
+    .respValid(div_respValid),
+    .op       (alu_op[1:0]),
+    .lhs      (rdata1),
+    .rhs      (rdata2),
+    .res      (div_res));
+
   always_comb begin
     case (inst_type)
       INST_JUMP:   alu_lhs = pc;
@@ -142,7 +170,7 @@ module exu (
 
       INST_UPP:     rf_wdata = alu_res;
       INST_AUIPC:   rf_wdata = alu_res;
-      INST_REG:     rf_wdata = alu_res;
+      INST_REG:     rf_wdata = is_div ? div_res : alu_res;
       INST_IMM:     rf_wdata = alu_res;
 
       INST_CSR:     rf_wdata = csr_rdata;
@@ -158,52 +186,53 @@ module exu (
     endcase
   end
 
+  logic is_ifu_wait;
+  logic is_lsu_wait;
+  logic is_load_seen;
+  logic is_store_seen;
+  logic is_system_seen;
+  logic is_calc_seen;
+  logic is_jump_seen;
+  logic is_branch_seen;
+  logic is_branch_taken;
+
+  assign is_instret      = respValid;
+  assign is_ifu_wait     = next_state == EXU_STALL_IDU;
+  assign is_lsu_wait     = next_state == EXU_STALL_LSU;
+  assign is_load_seen    = respValid & (inst_type[5:3] == INST_LOAD);
+  assign is_store_seen   = respValid & (inst_type[5:3] == INST_STORE);
+  assign is_system_seen  = respValid & (inst_type[5:3] == INST_SYSTEM);
+  assign is_calc_seen    = respValid & (inst_type[5:4] == INST_EXEC) & (inst_type[0] == INST_CALC);
+  assign is_jump_seen    = respValid & is_jump;
+  assign is_branch_seen  = respValid & is_branch;
+  assign is_branch_taken = respValid & is_branch_true;
+
+  always_comb begin
+    perf_events                    = 0;
+    perf_events[PERF_IFU_WAIT]     = is_ifu_wait;
+    perf_events[PERF_LSU_WAIT]     = is_lsu_wait;
+    perf_events[PERF_LOAD]         = is_load_seen;
+    perf_events[PERF_STORE]        = is_store_seen;
+    perf_events[PERF_SYSTEM]       = is_system_seen;
+    perf_events[PERF_CALC]         = is_calc_seen;
+    perf_events[PERF_JUMP]         = is_jump_seen;
+    perf_events[PERF_BRANCH]       = is_branch_seen;
+    perf_events[PERF_BRANCH_TAKEN] = is_branch_taken;
+  end
+
 `ifdef verilator
 logic is_ebreak;
-logic is_instret;
-logic is_ifu_wait;
-logic is_lsu_wait;
-logic is_load_seen;
-logic is_store_seen;
-logic is_system_seen;
-logic is_calc_seen;
-logic is_jump_seen;
-logic is_branch_seen;
-logic is_branch_taken;
 
 assign is_ebreak       = (inst_type == INST_EBREAK) && (curr_state == EXU_EXECUTE);
-assign is_instret      = respValid;
-assign is_ifu_wait     = next_state == EXU_STALL_IDU;
-assign is_lsu_wait     = next_state == EXU_STALL_LSU;
-assign is_load_seen    = respValid & (inst_type[5:3] == INST_LOAD);
-assign is_store_seen   = respValid & (inst_type[5:3] == INST_STORE);
-assign is_system_seen  = respValid & (inst_type[5:3] == INST_SYSTEM);
-assign is_calc_seen    = respValid & (inst_type[5:4] == INST_EXEC) & (inst_type[0] == INST_CALC);
-assign is_jump_seen    = respValid & is_jump;
-assign is_branch_seen  = respValid & is_branch;
-assign is_branch_taken = respValid & is_branch_true;
-
-import "DPI-C" context task exu_perf_measure(
-  input bit is_ebreak,
-  input bit is_instret,
-  input bit is_ifu_wait,
-  input bit is_lsu_wait,
-  input bit is_load_seen,
-  input bit is_store_seen,
-  input bit is_system_seen,
-  input bit is_calc_seen,
-  input bit is_jump_seen,
-  input bit is_branch_seen,
-  input bit is_branch_taken);
-
-import "DPI-C" context task exu_perf_reset();
 
+// NOTE: sticky until the reset, read by the testbench after every cycle
+logic ebreak /* verilator public_flat_rd */;
 always_ff @(posedge clock or posedge reset) begin
   if (reset) begin
-    exu_perf_reset();
+    ebreak <= 1'b0;
   end
-  else begin
-    exu_perf_measure(is_ebreak, is_instret, is_ifu_wait, is_lsu_wait, is_load_seen, is_store_seen, is_system_seen, is_calc_seen, is_jump_seen, is_branch_seen, is_branch_taken);
+  else if (is_ebreak) begin
+    ebreak <= 1'b1;
   end
 end
 
@@ -215,6 +244,7 @@ always @ * begin
     EXU_START:     dbg_exu = "EXU_START";
     EXU_STALL_IDU: dbg_exu = "EXU_STALL_IDU";
     EXU_STALL_LSU: dbg_exu = "EXU_STALL_LSU";
+    EXU_STALL_DIV: dbg_exu = "EXU_STALL_DIV";
     EXU_EXECUTE:   dbg_exu = "EXU_EXECUTE";
     default:       dbg_exu = "EXU_NONE";
   endcase
@@ -0,0 +1,122 @@
+// NOTE: execute stage of the pipelined core (cpu_pipe.sv), the operands come forwarded,
+// loads and csr reads get their result later in the pipeline, divisions after div.sv answers
+module exu_pipe (
+  input  logic               clock,
+  input  logic               reset,
+
+  input  logic [REG_W_END:0] rdata1,
+  input  logic [REG_W_END:0] rdata2,
+  input  logic [REG_W_END:0] pc,
+  input  logic               is_rvc,
+
+  output logic               is_pc_jump,
+  output logic               is_branch_true,
+  output logic [REG_W_END:0] pc_next,
+  output logic [REG_W_END:0] result,
+  output logic [REG_W_END:0] lsu_addr,
+
+  input  logic               is_ebreak,
+
+  input  logic               div_reqValid, // a division in EX, its operands ready
+  output logic               div_respValid,
+
+  input  logic [ALU_OP_END:0]    alu_op,
+  input  logic [COM_OP_END:0]    com_op,
+  input  logic [REG_W_END:0]     imm,
+  input  logic [INST_TYPE_END:0] inst_type);
+
+/* verilator lint_off UNUSEDPARAM */
+`include "com_defines.vh"
+`include "reg_defines.vh"
+`include "alu_defines.vh"
+`include "inst_defines.vh"
+/* verilator lint_on UNUSEDPARAM */
+
+  logic               is_jump;
+  logic               is_branch;
+  logic [REG_W_END:0] pc_jump;
+  logic [REG_W_END:0] pc_inc;
+
+  logic [REG_W_END:0] alu_lhs;
+  logic [REG_W_END:0] alu_rhs;
+  logic [REG_W_END:0] alu_res;
+  logic               com_res;
+  logic               is_div;
+  logic [REG_W_END:0] div_res;
+
+  alu u_alu(
+    .op(alu_op),
+    .lhs(alu_lhs),
+    .rhs(alu_rhs),
+    .res(alu_res));
+
+  com u_com(
+    .op(com_op),
+    .lhs(rdata1),
+    .rhs(rdata2),
+    .res(com_res));
+
+  div u_div(
+    .clock    (clock),
+    .reset    (reset),
+    .reqValid (div_reqValid),
+    .respValid(div_respValid),
+    .op       (alu_op[1:0]),
+    .lhs      (rdata1),
+    .rhs      (rdata2),
+    .res      (div_res));
+
+  assign is_jump        = (inst_type == INST_JUMP) | (inst_type == INST_JUMPR);
+  assign is_branch      = inst_type == INST_BRANCH;
+  assign is_branch_true = is_branch & com_res;
+  assign is_div         = inst_type == INST_REG && alu_op[4] && alu_op[2];
+
+  assign is_pc_jump = is_jump | is_branch_true;
+  assign pc_jump    = alu_res;
+  assign pc_inc     = pc + (is_rvc ? 32'd2 : 32'd4);
+  assign pc_next    = is_pc_jump ? pc_jump : pc_inc;
+  assign lsu_addr   = alu_res;
+
+  always_comb begin
+    case (inst_type)
+      INST_JUMP:   alu_lhs = pc;
+      INST_AUIPC:  alu_lhs = pc;
+      INST_BRANCH: alu_lhs = pc;
+      default:     alu_lhs = rdata1;
+    endcase
+  end
+
+  always_comb begin
+    case (inst_type)
+      INST_REG:  alu_rhs = rdata2;
+      default:   alu_rhs = imm;
+    endcase
+  end
+
+  always_comb begin
+    case (inst_type)
+      INST_JUMP:    result = pc_inc;
+      INST_JUMPR:   result = pc_inc;
+
+      INST_UPP:     result = alu_res;
+      INST_AUIPC:   result = alu_res;
+      INST_REG:     result = is_div ? div_res : alu_res;
+      INST_IMM:     result = alu_res;
+
+      default:      result = 0;
+    endcase
+  end
+
+`ifdef verilator
+// NOTE: sticky until the reset, read by the testbench after every cycle; set when the ebreak retires
+logic ebreak /* verilator public_flat_rd */;
+always_ff @(posedge clock or posedge reset) begin
+  if (reset) begin
+    ebreak <= 1'b0;
+  end
+  else if (is_ebreak) begin
+    ebreak <= 1'b1;
+  end
+end
+`endif
+endmodule
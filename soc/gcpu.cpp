@@ -12,6 +12,15 @@
 #define ALU_OP_SRA  (0b1101) 
 #define ALU_OP_OR   (0b0110) 
 #define ALU_OP_AND  (0b0111) 
+// NOTE: the M extension, ALU_OP_MUL | funct3
+#define ALU_OP_MUL    (0b10000)
+#define ALU_OP_MULH   (0b10001)
+#define ALU_OP_MULHSU (0b10010)
+#define ALU_OP_MULHU  (0b10011)
+#define ALU_OP_DIV    (0b10100)
+#define ALU_OP_DIVU   (0b10101)
+#define ALU_OP_REM    (0b10110)
+#define ALU_OP_REMU   (0b10111)
 
 #define COM_OP_EQ  (0b000)
 #define COM_OP_NE  (0b001)
@@ -30,6 +39,41 @@
 #define INST_CSRRSI     (0b10110)
 #define INST_CSRRCI     (0b10111)
 
+#define CSR_MCYCLE        (0xB00)
+#define CSR_MCYCLEH       (0xB80)
+#define CSR_MINSTRET      (0xB02)
+#define CSR_MINSTRETH     (0xB82)
+#define CSR_MHPMCOUNTER3  (0xB03)
+#define CSR_MHPMCOUNTER3H (0xB83)
+#define CSR_MVENDORID     (0xF11)
+#define CSR_MARCHID       (0xF12)
+#define CSR_HPM_N         (20) // mhpmcounter3..22, the events of perf_defines.vh
+
+// NOTE: the mhpmcounter events of perf_defines.vh
+#define PERF_IFU_WAIT      (0)
+#define PERF_LSU_WAIT      (1)
+#define PERF_LOAD          (2)
+#define PERF_STORE         (3)
+#define PERF_SYSTEM        (4)
+#define PERF_CALC          (5)
+#define PERF_JUMP          (6)
+#define PERF_BRANCH        (7)
+#define PERF_BRANCH_TAKEN  (8)
+#define PERF_ICACHE_HIT    (9)
+#define PERF_ICACHE_MISS   (10)
+#define PERF_ICACHE_REFILL (11)
+#define PERF_BRANCH_MISPREDICT (12)
+#define PERF_BTB_HIT       (13)
+#define PERF_DCACHE_HIT    (14)
+#define PERF_DCACHE_MISS   (15)
+#define PERF_DCACHE_WRITEBACK (16)
+#define PERF_PREFETCH_USEFUL  (17)
+#define PERF_PREFETCH_USELESS (18)
+#define PERF_FUSED            (19)
+
+#define CSR_MVENDORID_VAL (0x616b6562) // "akeb"
+#define CSR_MARCHID_VAL   (0x05318008)
+
 #define INST_LOAD_BYTE  (0b01100)
 #define INST_LOAD_HALF  (0b01101)
 #define INST_LOAD_WORD  (0b01110)
@@ -74,20 +118,41 @@ struct Vuart {
   bool      lsr_packed;
 };
 
+// NOTE: the counter registers of csr.sv and the ebreak flag of exu.sv
 struct VEventCounts {
   uint64_t& mcycle;
-  uint8_t  ebreak;
-  uint64_t minstret;
-  uint64_t mifu_wait;
-  uint64_t mlsu_wait;
-  uint64_t mload_seen;
-  uint64_t mstore_seen;
-  uint64_t msystem_seen;
-  uint64_t mcalc_seen;
-  uint64_t mjump_seen;
-  uint64_t mbranch_seen;
-  uint64_t mbranch_taken;
-  uint64_t micache_hits;
+  uint8_t&  ebreak;
+  uint64_t& minstret;
+  uint64_t& mifu_wait;
+  uint64_t& mlsu_wait;
+  uint64_t& mload_seen;
+  uint64_t& mstore_seen;
+  uint64_t& msystem_seen;
+  uint64_t& mcalc_seen;
+  uint64_t& mjump_seen;
+  uint64_t& mbranch_seen;
+  uint64_t& mbranch_taken;
+  uint64_t& micache_hits;
+  uint64_t& micache_misses;
+  uint64_t& micache_refills;
+  uint64_t& mbranch_mispredicts;
+  uint64_t& mbtb_hits;
+  uint64_t& mdcache_hits;
+  uint64_t& mdcache_misses;
+  uint64_t& mdcache_writebacks;
+  uint64_t& mprefetch_useful;
+  uint64_t& mprefetch_useless;
+  uint64_t& mfused;
+};
+
+struct VSoCbus {
+  uint8_t&  io_ifu_reqValid;
+  uint8_t&  io_ifu_respValid;
+  uint32_t& io_ifu_addr;
+  uint8_t&  io_lsu_reqValid;
+  uint8_t&  io_lsu_respValid;
+  uint32_t& io_lsu_addr;
+  uint8_t&  io_lsu_wen;
 };
 
 struct VSoCcpu {
@@ -95,6 +160,7 @@ struct VSoCcpu {
   VlUnpacked<uint32_t, 16>&  regs;
   VlUnpacked<uint16_t, 16777216>& mem;
   Vuart uart;
+  VSoCbus bus;
 
   VEventCounts event_counts;
   uint64_t minstret_start;
@@ -108,11 +174,16 @@ struct Gcpu {
   uint8_t flash[FLASH_SIZE+4];
 
   uint8_t ebreak           = false;
+  uint64_t minstret        = 0;
+  bool    is_csr_timing    = false; // rd holds a cycle/event counter, only the model knows its value
+  uint8_t csr_rd           = 0;
   bool    is_not_mapped    = false;
   bool    is_mem_write     = false;
   uint32_t written_address = 0;
   VerboseLevel verbose     = VerboseFailed;
   Vuart*  vuart;
+  uint8_t  uart_lcr        = 0b0000'0011;
+  Console* console         = NULL;
 };
 
 void g_reset(Gcpu* cpu) {
@@ -123,12 +194,16 @@ void g_reset(Gcpu* cpu) {
   // memset(cpu->flash, 0, FLASH_SIZE);
   cpu->pc = INITIAL_PC;
   cpu->ebreak = 0;
+  cpu->minstret = 0;
+  cpu->is_csr_timing = false;
+  cpu->csr_rd = 0;
   for (uint32_t i = 0; i < N_REGS; i++) {
     cpu->regs[i] = 0;
   }
   cpu->is_not_mapped = 0;
   cpu->is_mem_write  = 0;
   cpu->written_address = 0;
+  cpu->uart_lcr = 0b0000'0011;
 }
 
 void g_flash_init(Gcpu* cpu, uint8_t* data, uint32_t size) {
@@ -151,6 +226,13 @@ void g_mem_write(Gcpu* cpu, uint8_t wen, uint8_t wbmask, uint32_t addr, uint32_t
       }
     }
     else if (addr >= UART_START && addr < UART_END) {
+      // NOTE: only the line control is kept, it selects the divisor latch instead of the transmitter
+      if (addr == UART_START + 3) {
+        cpu->uart_lcr = wdata & 0xff;
+      }
+      if (addr == UART_START && !(cpu->uart_lcr & UART_LCR_DLAB) && cpu->console) {
+        console_put(cpu->console, wdata & 0xff);
+      }
     }
     else if (addr >= MEM_START && addr < MEM_END-3) {
       uint32_t mapped_addr = addr - MEM_START;
@@ -241,6 +323,20 @@ static bool slt(uint32_t a, uint32_t b) {
   return u32_as_i32(a) < u32_as_i32(b);
 }
 
+// NOTE: the RISC-V results of the division by zero (quotient all ones, remainder the dividend)
+// and of the overflow -2^31 / -1 (quotient -2^31, remainder 0), like div.sv
+static uint32_t div32(uint32_t a, uint32_t b) {
+  if (b == 0) return ~0u;
+  if (a == 0x8000'0000u && b == ~0u) return a;
+  return (uint32_t)(u32_as_i32(a) / u32_as_i32(b));
+}
+
+static uint32_t rem32(uint32_t a, uint32_t b) {
+  if (b == 0) return a;
+  if (a == 0x8000'0000u && b == ~0u) return 0;
+  return (uint32_t)(u32_as_i32(a) % u32_as_i32(b));
+}
+
 uint32_t alu_eval(uint8_t op, uint32_t lhs, uint32_t rhs) {
   uint32_t shamt = take_bits_range(rhs, 0, 4);
   uint32_t result = 0;
@@ -255,6 +351,14 @@ uint32_t alu_eval(uint8_t op, uint32_t lhs, uint32_t rhs) {
     case ALU_OP_SRA:  result = sra32(lhs, shamt); break;
     case ALU_OP_SLT:  result = slt(lhs, rhs);     break;
     case ALU_OP_SLTU: result = lhs < rhs;         break;
+    case ALU_OP_MUL:    result = lhs * rhs;                                                          break;
+    case ALU_OP_MULH:   result = (uint64_t)((int64_t)u32_as_i32(lhs) * (int64_t)u32_as_i32(rhs)) >> 32; break;
+    case ALU_OP_MULHSU: result = (uint64_t)((int64_t)u32_as_i32(lhs) * (int64_t)rhs) >> 32;            break;
+    case ALU_OP_MULHU:  result = ((uint64_t)lhs * rhs) >> 32;                                         break;
+    case ALU_OP_DIV:    result = div32(lhs, rhs);                                                     break;
+    case ALU_OP_DIVU:   result = rhs ? lhs / rhs : ~0u;                                               break;
+    case ALU_OP_REM:    result = rem32(lhs, rhs);                                                     break;
+    case ALU_OP_REMU:   result = rhs ? lhs % rhs : lhs;                                               break;
   }
   return result;
 }
@@ -272,12 +376,12 @@ uint32_t compare(uint8_t op, uint32_t lhs, uint32_t rhs) {
   return result;
 }
 
-void pc_write(Gcpu* cpu, uint32_t in_addr, uint8_t is_jump) {
+void pc_write(Gcpu* cpu, uint32_t in_addr, uint8_t is_jump, uint32_t size) {
   if (is_jump) {
     cpu->pc = in_addr;
   }
   else {
-    cpu->pc += 4;
+    cpu->pc += size;
   }
 }
 
@@ -354,7 +458,8 @@ Dec_out decode(uint32_t inst) {
     } break;
     case OPCODE_CALC_REG: {
       out.inst_type = INST_REG;
-      out.alu_op = (sub & (funct3==FUNCT3_SR || funct3==FUNCT3_ADD)) << 3 | funct3;
+      if (funct7 == FUNCT7_MULDIV) out.alu_op = ALU_OP_MUL | funct3;
+      else out.alu_op = (sub & (funct3==FUNCT3_SR || funct3==FUNCT3_ADD)) << 3 | funct3;
     } break;
     case OPCODE_LOAD: {
       out.imm = i_imm;
@@ -400,7 +505,11 @@ Dec_out decode(uint32_t inst) {
     } break;
     case OPCODE_SYSTEM: {
       out.inst_type = 0;
-      out.ebreak = take_bit(inst, 20);
+      out.ebreak = !funct3 && take_bit(inst, 20);
+      if (funct3 && funct3 != 0b100) {
+        out.imm = take_bits_range(inst, 20, 31);
+        out.inst_type = INST_EBREAK | funct3;
+      }
     } break;
     default:
       out.inst_type = 0;
@@ -411,9 +520,27 @@ Dec_out decode(uint32_t inst) {
   return out;
 }
 
+// NOTE: the counters are read only, like in csr.sv, csr writes are ignored
+uint32_t g_csr_read(Gcpu* cpu, uint32_t addr) {
+  switch (addr) {
+    case CSR_MVENDORID: return CSR_MVENDORID_VAL;
+    case CSR_MARCHID:   return CSR_MARCHID_VAL;
+    case CSR_MINSTRET:  return cpu->minstret;
+    case CSR_MINSTRETH: return cpu->minstret >> 32;
+    case CSR_MCYCLE:    cpu->is_csr_timing = true; return 0;
+    case CSR_MCYCLEH:   cpu->is_csr_timing = true; return 0;
+  }
+  if (addr - CSR_MHPMCOUNTER3 < CSR_HPM_N || addr - CSR_MHPMCOUNTER3H < CSR_HPM_N) {
+    cpu->is_csr_timing = true;
+  }
+  return 0;
+}
+
 uint8_t cpu_eval(Gcpu* cpu) {
-  uint32_t inst = g_mem_read(cpu, cpu->pc & ~3);
-  Dec_out  dec  = decode(inst);
+  // NOTE: the 32 bits at pc, a 16-bit instruction (RV32C) is decoded as its 32-bit form
+  uint32_t fetched = g_mem_read(cpu, cpu->pc & ~1);
+  uint32_t size    = inst_size(fetched);
+  Dec_out  dec     = decode(inst_expand(fetched));
   if (dec.inst_type == 0) cpu->is_not_mapped = 1;
   RF_out   rf   = rf_read(cpu, dec.reg_src1, dec.reg_src2);
   bool is_mem_op =
@@ -439,6 +566,11 @@ uint8_t cpu_eval(Gcpu* cpu) {
   uint32_t alu_res = alu_eval(dec.alu_op, alu_lhs, alu_rhs);
   uint32_t com_res =  compare(dec.com_op, rf.rdata1, rf.rdata2);
 
+  cpu->is_csr_timing = false;
+  cpu->csr_rd = dec.reg_dest;
+  bool is_csr_op = (dec.inst_type & ~0b111) == INST_EBREAK && dec.inst_type != INST_EBREAK;
+  uint32_t csr_rdata = is_csr_op ? g_csr_read(cpu, dec.imm) : 0;
+
   uint32_t mem_rdata = is_mem_op ? g_mem_read(cpu, alu_res) : 0;
   uint32_t mem_rdata_byte = take_bits_range(mem_rdata, 0, 7);
   uint32_t mem_rdata_half = take_bits_range(mem_rdata, 0, 15);
@@ -453,19 +585,26 @@ uint8_t cpu_eval(Gcpu* cpu) {
     case INST_LOAD_HALF: pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = mem_half_extend; break;
     case INST_LOAD_WORD: pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = mem_rdata;       break;
     case INST_UPP:       pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = dec.imm;         break;
-    case INST_JUMP:      pc_jump = 1;       mem_wen = 0; reg_wen = 1; reg_wdata = cpu->pc+4;       break;
-    case INST_JUMPR:     pc_jump = 1;       mem_wen = 0; reg_wen = 1; reg_wdata = cpu->pc+4;       break;
+    case INST_JUMP:      pc_jump = 1;       mem_wen = 0; reg_wen = 1; reg_wdata = cpu->pc+size;    break;
+    case INST_JUMPR:     pc_jump = 1;       mem_wen = 0; reg_wen = 1; reg_wdata = cpu->pc+size;    break;
     case INST_AUIPC:     pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = alu_res;         break;
     case INST_REG:       pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = alu_res;         break;
     case INST_IMM:       pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = alu_res;         break;
     case INST_STORE:     pc_jump = 0;       mem_wen = 1; reg_wen = 0; reg_wdata = 0;               break;
     case INST_BRANCH:    pc_jump = com_res; mem_wen = 0; reg_wen = 0; reg_wdata = 0;               break;
+    case INST_CSRRW:
+    case INST_CSRRS:
+    case INST_CSRRC:
+    case INST_CSRRWI:
+    case INST_CSRRSI:
+    case INST_CSRRCI:    pc_jump = 0;       mem_wen = 0; reg_wen = 1; reg_wdata = csr_rdata;       break;
     default:             pc_jump = 0;       mem_wen = 0; reg_wen = 0; reg_wdata = 0;               break;
   }
 
   rf_write(cpu, reg_wen, dec.reg_dest, reg_wdata);
   g_mem_write(cpu, mem_wen, dec.mem_wbmask, alu_res, rf.rdata2);
-  pc_write(cpu, alu_res, pc_jump);
+  pc_write(cpu, alu_res, pc_jump, size);
   cpu->ebreak = dec.ebreak;
+  cpu->minstret++;
   return dec.ebreak;
 }
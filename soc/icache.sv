@@ -1,94 +1,158 @@
-module icache (
+module icache #(
+  parameter WAYS       = 2, // 2 or 4
+  parameter SETS       = 8,
+  parameter LINE_WORDS = 4  // 2 or more
+) (
   input  logic        clock,
   input  logic        reset,
-  input  logic        wen,
-  input  logic [31:0] wdata,
   input  logic [31:2] addr,
   input  logic        reqValid,
   output logic        is_hit,
   output logic        respValid,
-  output logic [31:0] rdata);
+  output logic [31:0] rdata,
 
-  localparam m = 2;
-  localparam n = 6;
-  localparam TAG_W  = 32-m-n;
-  localparam DATA_W = 8 * (2**m);
+  // NOTE: refill of the line of addr: refill_start picks the way, the words come one per wen in any order,
+  // refill_end comes with the last word and validates the line
+  input  logic                           refill_start,
+  input  logic                           wen,
+  input  logic [$clog2(LINE_WORDS)-1:0]  woffset,
+  input  logic [31:0]                    wdata,
+  input  logic                           refill_end,
+
+  // NOTE: lookup of a second line, without touching the replacement state (ifu prefetch)
+  input  logic [31:2+$clog2(LINE_WORDS)] probe_line,
+  output logic                           is_probe_hit);
+
+  localparam m = $clog2(LINE_WORDS);
+  localparam n = $clog2(SETS);
+  localparam TAG_W = 30-m-n;
+  localparam WAY_W = $clog2(WAYS);
 
 /*
-      ICACHE
-  +---+-----+------+
-  | 1 |TAG_W|DATA_W|
-  +---+-----+------+
-  | v | tag | data |
-  +---+-----+------+
-  |   |     |      | x16
-  +---+-----+------+
+      ICACHE, WAYS x SETS
+  +---+-----+----------------------+
+  | 1 |TAG_W| 32 x LINE_WORDS      |
+  +---+-----+----------------------+
+  | v | tag | word 0 | ... | word N|
+  +---+-----+----------------------+
+  |   |     |                      | x SETS
+  +---+-----+----------------------+
 */
 
-  typedef struct packed {
-    logic              valid;
-    logic [ TAG_W-1:0] tag;
-    logic [DATA_W-1:0] data;
-  } line_t;
+  logic             valid [0:WAYS-1][0:SETS-1];
+  logic [TAG_W-1:0] tags  [0:WAYS-1][0:SETS-1];
+  logic [31:0]      data  [0:WAYS-1][0:SETS-1][0:LINE_WORDS-1];
 
-  localparam LINE_N = 2**n;
-  line_t lines [0:LINE_N-1];
+  logic [TAG_W-1:0] tag;
+  logic [    n-1:0] index;
+  logic [    m-1:0] offset;
+  assign tag    = addr[   31:2+m+n];
+  assign index  = addr[m+n+1:  2+m];
+  assign offset = addr[  m+1:    2];
 
-  logic  [TAG_W-1:0]  tag;
-  logic  [    n-1:0]  index;
-  line_t              line;
-  assign tag    = addr[   31:m+n];
-  assign index  = addr[m+n-1:  m];
-  assign line   = lines[index];
-  assign rdata  = line.data;
+  logic             is_way_hit;
+  logic [WAY_W-1:0] hit_way;
+  always_comb begin
+    is_way_hit = 1'b0;
+    hit_way    = '0;
+    for (int w = 0; w < WAYS; w++) begin
+      if (valid[w][index] && tags[w][index] == tag) begin
+        is_way_hit = 1'b1;
+        hit_way    = WAY_W'(w);
+      end
+    end
+  end
 
-  logic  writeValid;
-  logic  readValid;
-  generate
-    for (genvar i = 0; i < LINE_N; i++) begin : gen_lines_ff
-      always_ff @(posedge clock or posedge reset) begin
-        if (reset) begin
-          lines[i].valid <= 1'b0;
-        end
-        else if (wen && i == index) begin
-          lines[i]   <= {1'b1, tag, wdata};
-        end
+  always_comb begin
+    is_probe_hit = 1'b0;
+    for (int w = 0; w < WAYS; w++) begin
+      if (valid[w][probe_line[m+n+1:2+m]] && tags[w][probe_line[m+n+1:2+m]] == probe_line[31:2+m+n]) begin
+        is_probe_hit = 1'b1;
       end
     end
-  endgenerate
+  end
+
+  assign respValid = reqValid;
+  assign is_hit    = reqValid && is_way_hit;
+  assign rdata     = data[hit_way][index][offset];
+
+  logic [WAY_W-1:0] victim;
+  logic [WAY_W-1:0] refill_way;
+  logic [    n-1:0] refill_index;
 
   always_ff @(posedge clock or posedge reset) begin
     if (reset) begin
-      writeValid <= 1'b0;
+      for (int w = 0; w < WAYS; w++) begin
+        for (int s = 0; s < SETS; s++) begin
+          valid[w][s] <= 1'b0;
+        end
+      end
+      refill_way   <= '0;
+      refill_index <= '0;
     end
     else begin
-      writeValid <= wen;
+      if (refill_start) begin
+        refill_way           <= victim;
+        refill_index         <= index;
+        valid[victim][index] <= 1'b0;
+        tags [victim][index] <= tag;
+      end
+      if (refill_end) begin
+        valid[refill_way][refill_index] <= 1'b1;
+      end
     end
   end
 
-  assign respValid = writeValid | readValid;
-  always_comb begin
-    is_hit    = 1'b0;
-    readValid = 1'b0;
-    if (reqValid && !wen) begin
-      is_hit    = line.valid && line.tag == tag;
-      readValid = 1'b1;
+  always_ff @(posedge clock) begin
+    if (wen) begin
+      data[refill_way][refill_index][woffset] <= wdata;
     end
   end
 
-`ifdef verilator
-import "DPI-C" context task icache_perf_measure(input bit is_hit);
-import "DPI-C" context task icache_perf_reset();
+  // NOTE: tree pseudo-LRU of 4 ways: bit 0 points to the half to replace, bits 1 and 2 to the way in the lower and upper half
+  function automatic logic [2:0] plru_touch(input logic [2:0] bits, input logic [1:0] way);
+    plru_touch    = bits;
+    plru_touch[0] = ~way[1];
+    if (way[1]) plru_touch[2] = ~way[0];
+    else        plru_touch[1] = ~way[0];
+  endfunction
 
-always_ff @(posedge clock or posedge reset) begin
-  if (reset) begin
-    icache_perf_reset();
-  end
-  else begin
-    icache_perf_measure(is_hit);
-  end
-end
-`endif
+  generate
+    if (WAYS == 2) begin : gen_plru2
+      // NOTE: one bit per set, the way to replace
+      logic plru [0:SETS-1];
+      assign victim = plru[index];
+      always_ff @(posedge clock or posedge reset) begin
+        if (reset) begin
+          for (int s = 0; s < SETS; s++) begin
+            plru[s] <= 1'b0;
+          end
+        end
+        else if (is_hit) begin
+          plru[index] <= ~hit_way;
+        end
+        else if (refill_end) begin
+          plru[refill_index] <= ~refill_way;
+        end
+      end
+    end
+    else begin : gen_plru4
+      logic [2:0] plru [0:SETS-1];
+      assign victim = plru[index][0] ? {1'b1, plru[index][2]} : {1'b0, plru[index][1]};
+      always_ff @(posedge clock or posedge reset) begin
+        if (reset) begin
+          for (int s = 0; s < SETS; s++) begin
+            plru[s] <= 3'b0;
+          end
+        end
+        else if (is_hit) begin
+          plru[index] <= plru_touch(plru[index], hit_way);
+        end
+        else if (refill_end) begin
+          plru[refill_index] <= plru_touch(plru[refill_index], refill_way);
+        end
+      end
+    end
+  endgenerate
 
 endmodule
-
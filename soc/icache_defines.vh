@@ -0,0 +1,6 @@
+// geometry of the icache, powers of 2: 2 or 4 ways, lines of 2 or more words
+localparam ICACHE_WAYS       = 2;
+localparam ICACHE_SETS       = 8;
+localparam ICACHE_LINE_WORDS = 4;
+// NOTE: 1 -- the ifu prefetches the next line of a refilled line into a one line stream buffer, 0 -- no prefetch
+localparam ICACHE_PREFETCH   = 1;
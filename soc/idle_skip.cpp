@@ -0,0 +1,196 @@
+#include <cstdint>
+#include <cstdio>
+
+// NOTE: idle loop skipping for vcpu. A loop is idle when its last IDLE_ITERS iterations
+// - retired the same short pc sequence,
+// - took the same number of cycles and counted the same events,
+// - did no store, loaded the same value from the same address at every position,
+// - read csrs whose value grows by the same step every iteration (mcycle, minstret, mhpmcounters).
+// Then the following iterations repeat the same timing as long as they follow the same pcs,
+// so they are evaluated here, without the model, and the model state is moved past them.
+#define IDLE_MAX_BODY  (16)
+#define IDLE_ITERS     (4)
+#define IDLE_HISTORY   (IDLE_MAX_BODY * (IDLE_ITERS + 1))
+#define IDLE_COUNTERS  (22) // mcycle, minstret, mhpmcounter3..22
+#define IDLE_MAX_SKIP  (1 << 24)
+
+struct IdleRetire {
+  uint32_t pc;
+  uint32_t inst;
+  uint32_t rd_value;
+  uint32_t lsu_addr;
+  uint64_t counters[IDLE_COUNTERS];
+};
+
+struct IdleSkip {
+  IdleRetire history[IDLE_HISTORY];
+  uint64_t   retires;
+
+  uint64_t   skips;
+  uint64_t   skipped_iters;
+  uint64_t   skipped_insts;
+  uint64_t   skipped_cycles;
+};
+
+struct IdleLoop {
+  uint32_t body;
+  uint64_t iters;
+  uint64_t deltas[IDLE_COUNTERS]; // per iteration
+  uint32_t regs[N_REGS];          // at the end of the last skipped iteration
+};
+
+// NOTE: the history does not survive a cpu reset, the statistics do
+void idle_reset(IdleSkip* skip) {
+  skip->retires = 0;
+}
+
+void idle_push(IdleSkip* skip, IdleRetire* retire) {
+  skip->history[skip->retires % IDLE_HISTORY] = *retire;
+  skip->retires++;
+}
+
+// NOTE: back 0 is the newest retire
+static IdleRetire* idle_at(IdleSkip* skip, uint32_t back) {
+  return &skip->history[(skip->retires - 1 - back) % IDLE_HISTORY];
+}
+
+static bool idle_is_csr(Dec_out* dec) {
+  return (dec->inst_type & ~0b111) == INST_EBREAK && dec->inst_type != INST_EBREAK;
+}
+
+static bool idle_is_load(Dec_out* dec) {
+  return dec->inst_type == INST_LOAD_BYTE || dec->inst_type == INST_LOAD_HALF || dec->inst_type == INST_LOAD_WORD;
+}
+
+// NOTE: INST_REG includes mul/div, alu_eval gives their results and div.sv takes the same cycles for any operands
+static bool idle_is_supported(Dec_out* dec) {
+  switch (dec->inst_type) {
+    case INST_IMM:
+    case INST_REG:
+    case INST_UPP:
+    case INST_AUIPC:
+    case INST_JUMP:
+    case INST_JUMPR:
+    case INST_BRANCH:
+      return true;
+  }
+  return idle_is_load(dec) || idle_is_csr(dec);
+}
+
+// NOTE: IdleRetire::counters index of a csr high half, -1 for any other csr
+static int32_t idle_counter_high(uint32_t csr) {
+  if (csr == CSR_MCYCLEH)   return 0;
+  if (csr == CSR_MINSTRETH) return 1;
+  if (csr - CSR_MHPMCOUNTER3H < CSR_HPM_N) return 2 + (csr - CSR_MHPMCOUNTER3H);
+  return -1;
+}
+
+// NOTE: next_pc is the pc the model fetches next, regs are its registers after the newest retire,
+// max_cycles bounds the skip. Returns false when the newest retire does not close an idle loop.
+bool idle_detect(IdleSkip* skip, uint32_t next_pc, uint32_t* regs, uint64_t max_cycles, IdleLoop* loop) {
+  if (!skip->retires || next_pc > idle_at(skip, 0)->pc) return false;
+
+  uint32_t body = 0;
+  for (uint32_t p = 1; p <= IDLE_MAX_BODY && p <= skip->retires; p++) {
+    if (idle_at(skip, p - 1)->pc == next_pc) {
+      body = p;
+      break;
+    }
+  }
+  if (!body || skip->retires < body * (IDLE_ITERS + 1)) return false;
+
+  for (uint32_t j = 0; j < body * IDLE_ITERS; j++) {
+    if (idle_at(skip, j)->pc   != idle_at(skip, j + body)->pc)   return false;
+    if (idle_at(skip, j)->inst != idle_at(skip, j + body)->inst) return false;
+  }
+
+  for (uint32_t c = 0; c < IDLE_COUNTERS; c++) {
+    loop->deltas[c] = idle_at(skip, 0)->counters[c] - idle_at(skip, body)->counters[c];
+    for (uint32_t it = 1; it < IDLE_ITERS; it++) {
+      uint64_t delta = idle_at(skip, it * body)->counters[c] - idle_at(skip, (it + 1) * body)->counters[c];
+      if (delta != loop->deltas[c]) return false;
+    }
+  }
+
+  Dec_out  decs[IDLE_MAX_BODY];
+  uint32_t sizes[IDLE_MAX_BODY];
+  uint32_t csr_steps[IDLE_MAX_BODY] = {};
+  for (uint32_t i = 0; i < body; i++) {
+    uint32_t back = body - 1 - i;
+    IdleRetire* last = idle_at(skip, back);
+    decs[i]  = decode(inst_expand(last->inst));
+    sizes[i] = inst_size(last->inst);
+    if (!idle_is_supported(&decs[i])) return false;
+    if (idle_is_csr(&decs[i])) {
+      csr_steps[i] = last->rd_value - idle_at(skip, back + body)->rd_value;
+    }
+    for (uint32_t it = 0; it < IDLE_ITERS; it++) {
+      IdleRetire* now = idle_at(skip, back + it * body);
+      IdleRetire* pre = idle_at(skip, back + (it + 1) * body);
+      if (idle_is_csr(&decs[i])  && now->rd_value - pre->rd_value != csr_steps[i]) return false;
+      if (idle_is_load(&decs[i]) && (now->rd_value != pre->rd_value || now->lsu_addr != pre->lsu_addr)) return false;
+    }
+  }
+
+  uint64_t max_iters = loop->deltas[0] ? max_cycles / loop->deltas[0] : 0;
+  if (max_iters > IDLE_MAX_SKIP) max_iters = IDLE_MAX_SKIP;
+  // NOTE: the low halves wrap like the uint32_t steps, a high half read must not see a carry
+  for (uint32_t i = 0; i < body; i++) {
+    int32_t c = idle_is_csr(&decs[i]) ? idle_counter_high(decs[i].imm) : -1;
+    if (c < 0 || !loop->deltas[c]) continue;
+    uint64_t now  = idle_at(skip, 0)->counters[c];
+    uint64_t room = (((now >> 32) + 1) << 32) - now;
+    uint64_t iters = room / loop->deltas[c];
+    iters = iters ? iters - 1 : 0;
+    if (max_iters > iters) max_iters = iters;
+  }
+
+  uint32_t r[N_REGS];
+  for (uint32_t i = 0; i < N_REGS; i++) r[i] = regs[i];
+  loop->body  = body;
+  loop->iters = 0;
+  for (uint64_t k = 1; k <= max_iters; k++) {
+    for (uint32_t i = 0; i < body; i++) {
+      IdleRetire* last = idle_at(skip, body - 1 - i);
+      Dec_out* dec = &decs[i];
+      uint32_t pc  = last->pc;
+      uint32_t lhs = (dec->inst_type == INST_JUMP || dec->inst_type == INST_AUIPC || dec->inst_type == INST_BRANCH) ? pc : r[dec->reg_src1];
+      uint32_t rhs = dec->inst_type == INST_REG ? r[dec->reg_src2] : dec->imm;
+      uint32_t alu_res = alu_eval(dec->alu_op, lhs, rhs);
+
+      uint32_t rd_value = 0;
+      uint32_t pc_next  = pc + sizes[i];
+      switch (dec->inst_type) {
+        case INST_UPP:    rd_value = dec->imm; break;
+        case INST_JUMP:
+        case INST_JUMPR:  rd_value = pc + sizes[i]; pc_next = alu_res; break;
+        case INST_BRANCH: if (compare(dec->com_op, r[dec->reg_src1], r[dec->reg_src2])) pc_next = alu_res; break;
+        default:          rd_value = alu_res; break;
+      }
+      if (idle_is_load(dec)) {
+        if (alu_res != last->lsu_addr) return loop->iters > 0;
+        rd_value = last->rd_value;
+      }
+      if (idle_is_csr(dec)) {
+        rd_value = last->rd_value + (uint32_t)k * csr_steps[i];
+      }
+      if (pc_next != (i + 1 < body ? idle_at(skip, body - 2 - i)->pc : next_pc)) return loop->iters > 0;
+
+      if (dec->inst_type != INST_BRANCH && dec->reg_dest != 0 && dec->reg_dest < N_REGS) {
+        r[dec->reg_dest] = rd_value;
+      }
+    }
+    loop->iters = k;
+    for (uint32_t i = 0; i < N_REGS; i++) loop->regs[i] = r[i];
+  }
+  return loop->iters > 0;
+}
+
+void idle_print(IdleSkip* skip, const char* cpu_name) {
+  printf("[INFO] %s idle skip: %lu loops, %lu iterations, %lu instructions, %lu cycles skipped\n",
+         cpu_name,
+         skip->skips,
+         skip->skipped_iters,
+         skip->skipped_insts,
+         skip->skipped_cycles);
+}
@@ -1,4 +1,6 @@
-module ifu (
+module ifu #(
+  parameter BUS_DEPTH = 1 // requests in flight on the bus port, answered in order
+) (
   input  logic  clock,
   input  logic  reset,
 
@@ -10,60 +12,206 @@ module ifu (
   input  logic [31:0] pc,
   input  logic        reqValid,
   output logic        respValid,
+  input  logic        is_lsu_busy,
+  output logic        is_icache_hit,
+  output logic        is_icache_miss,
+  output logic        is_icache_refill,
+  output logic        is_prefetch_useful,
+  output logic        is_prefetch_useless,
   output logic [31:0] inst);
 
-  logic        icache_wen;
-  logic [31:0] icache_wdata;
-  logic [31:2] icache_addr;
+/* verilator lint_off UNUSEDPARAM */
+`include "icache_defines.vh"
+/* verilator lint_on UNUSEDPARAM */
+
+  localparam OFFSET_W = $clog2(ICACHE_LINE_WORDS);
+
   logic        icache_hit;
   logic [31:0] icache_rdata;
   logic        icache_reqValid;
   logic        icache_respValid;
- 
-  assign icache_wdata = inst;
-  icache u_icache(
+  logic        icache_refill_start;
+  logic        icache_wen;
+  logic        icache_refill_end;
+  logic [31:0] icache_wdata;
+  logic        icache_probe_hit;
+
+  // NOTE: a miss refills the whole line over the bus, one request per word, starting from the missed word.
+  // That word goes to the core as soon as it comes. A fetch that comes during the rest of the refill
+  // takes its word when it comes, or the lookup after the end of the refill when the word came already.
+  // The request of the next word is registered: it is high from the posedge after the response,
+  // where the bus agents sample it, not only from the response to the posedge.
+  // With BUS_DEPTH > 1 the next words are requested one per cycle while fewer than BUS_DEPTH are in flight,
+  // the responses come in order, so the line streams in as a burst would.
+  logic [31:2+OFFSET_W] refill_line;
+  logic [OFFSET_W-1:0]  refill_offset;
+  logic [OFFSET_W:0]    refill_words;
+  logic [OFFSET_W-1:0]  req_offset;
+  logic [OFFSET_W:0]    req_words;
+  logic [OFFSET_W:0]    req_words_next;
+  logic [OFFSET_W:0]    refill_words_next;
+  logic                 is_critical;
+  logic                 is_pending;
+  logic                 is_refill_req;
+
+  // NOTE: the next line prefetch (ICACHE_PREFETCH). After a line is refilled, the next line, when it is in the same
+  // 4KB page and not in the icache, is read into a one line stream buffer, word 0 first, in the cycles the lsu is not
+  // on the bus. A fetch that misses the icache and hits the buffer takes its word at once, the line then moves into the
+  // icache one word per cycle (IFU_FILL) and the line after it is prefetched. A fetch of another line that misses
+  // the icache stops the prefetch after the words in flight.
+  logic [31:2+OFFSET_W] pf_line;
+  logic [OFFSET_W-1:0]  pf_offset;
+  logic [OFFSET_W:0]    pf_words;
+  logic [OFFSET_W:0]    pf_req_words;
+  logic [OFFSET_W:0]    pf_words_next;
+  logic [OFFSET_W:0]    pf_req_words_next;
+  logic [31:0]          pf_data [0:ICACHE_LINE_WORDS-1];
+  logic                 pf_valid;
+  logic                 is_pf_req;
+  logic                 is_pf_stop;
+  logic                 is_pf_hit;
+  logic                 is_pf_next;
+  logic                 is_pf_abort;
+  logic                 is_pf_last;
+  logic                 is_fetch;
+  logic [31:2+OFFSET_W] pc_line;
+  logic [OFFSET_W-1:0]  pc_offset;
+  logic [31:2+OFFSET_W] next_line;
+
+  assign is_fetch   = reqValid || is_pending;
+  assign pc_line    = pc[31:2+OFFSET_W];
+  assign pc_offset  = pc[1+OFFSET_W:2];
+  assign next_line  = refill_line + 1'b1;
+  assign is_pf_hit  = pf_valid && pc_line == pf_line;
+  assign pf_offset  = pf_words[OFFSET_W-1:0];
+  assign is_pf_last = pf_words == (OFFSET_W+1)'(ICACHE_LINE_WORDS - 1);
+  assign is_pf_next = ICACHE_PREFETCH != 0 && next_line[11:2+OFFSET_W] != '0 && !icache_probe_hit &&
+                      !(pf_valid && pf_line == next_line);
+  assign is_pf_abort = is_fetch && !icache_hit && pc_line != pf_line;
+
+  icache #(
+    .WAYS      (ICACHE_WAYS),
+    .SETS      (ICACHE_SETS),
+    .LINE_WORDS(ICACHE_LINE_WORDS)
+  ) u_icache(
     .clock(clock),
     .reset(reset),
-    .wen      (icache_wen),
-    .wdata    (icache_wdata),
-    .addr     (icache_addr[31:2]),
-    .is_hit   (icache_hit),
-    .reqValid (icache_reqValid),
-    .respValid(icache_respValid),
-    .rdata    (icache_rdata));
-
-  typedef enum logic [1:0] {
-    IFU_IDLE, IFU_WAIT_ICACHE, IFU_WAIT_IO, IFU_WRITE_ICACHE
+    .addr        (pc[31:2]),
+    .is_hit      (icache_hit),
+    .reqValid    (icache_reqValid),
+    .respValid   (icache_respValid),
+    .rdata       (icache_rdata),
+    .refill_start(icache_refill_start),
+    .wen         (icache_wen),
+    .woffset     (refill_offset),
+    .wdata       (icache_wdata),
+    .refill_end  (icache_refill_end),
+    .probe_line  (next_line),
+    .is_probe_hit(icache_probe_hit));
+
+  typedef enum logic [2:0] {
+    IFU_IDLE, IFU_WAIT_ICACHE, IFU_REFILL, IFU_PREFETCH, IFU_FILL
   } ifu_state;
 
   ifu_state next_state;
   ifu_state curr_state;
 
+  assign is_icache_hit    = icache_hit;
+  assign is_icache_miss   = icache_refill_start;
+  assign is_icache_refill = curr_state == IFU_REFILL;
+  assign icache_wdata     = curr_state == IFU_FILL ? pf_data[refill_offset] : io_rdata;
+
+  // NOTE: the words requested and answered after this cycle, the next word is requested while fewer than
+  // BUS_DEPTH are in flight
+  assign req_words_next    = icache_refill_start ? (OFFSET_W+1)'(io_reqValid) : req_words + (OFFSET_W+1)'(io_reqValid);
+  assign refill_words_next = icache_refill_start ? '0 : refill_words + (OFFSET_W+1)'(curr_state == IFU_REFILL && io_respValid);
+  assign pf_req_words_next = curr_state != IFU_PREFETCH ? '0 : pf_req_words + (OFFSET_W+1)'(io_reqValid);
+  assign pf_words_next     = curr_state != IFU_PREFETCH ? '0 : pf_words + (OFFSET_W+1)'(io_respValid);
+
+  // NOTE: a prefetched line is useful when a fetch takes it from the buffer,
+  // useless when the next prefetch overwrites it or the prefetch stops before its last word
+  assign is_prefetch_useful  = curr_state != IFU_FILL && next_state == IFU_FILL;
+  assign is_prefetch_useless = (curr_state == IFU_REFILL && next_state == IFU_PREFETCH && pf_valid) ||
+                               (curr_state == IFU_PREFETCH && next_state != IFU_PREFETCH && !(io_respValid && is_pf_last));
+
   always_ff @(posedge clock or posedge reset) begin
     if (reset) begin
-      curr_state <= IFU_IDLE;
+      curr_state    <= IFU_IDLE;
+      refill_line   <= '0;
+      refill_offset <= '0;
+      refill_words  <= '0;
+      is_critical   <= 1'b0;
+      is_pending    <= 1'b0;
+      is_refill_req <= 1'b0;
+      req_offset    <= '0;
+      req_words     <= '0;
+      pf_line       <= '0;
+      pf_words      <= '0;
+      pf_req_words  <= '0;
+      pf_valid      <= 1'b0;
+      is_pf_req     <= 1'b0;
+      is_pf_stop    <= 1'b0;
     end else begin
-      if (reqValid) begin
-        curr_state <= next_state;
+      curr_state    <= next_state;
+      is_pending    <= curr_state != IFU_IDLE && curr_state != IFU_WAIT_ICACHE && is_fetch && !respValid;
+      is_refill_req <= next_state == IFU_REFILL && req_words_next < (OFFSET_W+1)'(ICACHE_LINE_WORDS) &&
+                       req_words_next - refill_words_next < (OFFSET_W+1)'(BUS_DEPTH);
+      is_pf_stop    <= curr_state == IFU_PREFETCH && next_state == IFU_PREFETCH && (is_pf_stop || is_pf_abort);
+      is_pf_req     <= next_state == IFU_PREFETCH && !(curr_state == IFU_PREFETCH && (is_pf_stop || is_pf_abort)) &&
+                       pf_req_words_next < (OFFSET_W+1)'(ICACHE_LINE_WORDS) &&
+                       pf_req_words_next - pf_words_next < (OFFSET_W+1)'(BUS_DEPTH);
+      req_words     <= req_words_next;
+      pf_req_words  <= pf_req_words_next;
+      pf_words      <= pf_words_next;
+      if (icache_refill_start) begin
+        req_offset <= pc[1+OFFSET_W:2] + 1'b1;
+      end
+      else if (io_reqValid) begin
+        req_offset <= req_offset + 1'b1;
+      end
+      if (curr_state != IFU_PREFETCH && next_state == IFU_PREFETCH) begin
+        pf_line   <= next_line;
+        pf_valid  <= 1'b0;
+      end
+      else if (curr_state == IFU_PREFETCH && io_respValid) begin
+        pf_valid  <= is_pf_last;
+      end
+      else if (curr_state == IFU_FILL && next_state != IFU_FILL) begin
+        pf_valid  <= 1'b0;
       end
-      else if (io_respValid || icache_respValid) begin
-        curr_state <= next_state;
+      if (icache_refill_start) begin
+        refill_line   <= pc[31:2+OFFSET_W];
+        refill_offset <= pc[1+OFFSET_W:2];
+        refill_words  <= '0;
+        is_critical   <= 1'b1;
+      end
+      else if ((curr_state == IFU_REFILL && io_respValid) || curr_state == IFU_FILL) begin
+        refill_offset <= refill_offset + 1'b1;
+        refill_words  <= refill_words + 1'b1;
+        is_critical   <= 1'b0;
       end
     end
   end
 
+  always_ff @(posedge clock) begin
+    if (curr_state == IFU_PREFETCH && io_respValid) begin
+      pf_data[pf_offset] <= io_rdata;
+    end
+  end
+
   always_comb begin
-    next_state      = curr_state;
-    respValid       = 1'b0;
-    io_reqValid     = 1'b0;
-    icache_reqValid = 1'b0;
-    io_addr         = pc;
-    icache_addr     = pc[31:2];
-    icache_wen      = 1'b0;
-    inst            = 32'b0;
+    next_state          = curr_state;
+    respValid           = 1'b0;
+    io_reqValid         = 1'b0;
+    io_addr             = {refill_line, req_offset, 2'b00};
+    icache_reqValid     = 1'b0;
+    icache_refill_start = 1'b0;
+    icache_wen          = 1'b0;
+    icache_refill_end   = 1'b0;
+    inst                = 32'b0;
     case (curr_state)
       IFU_IDLE: begin
-        if (reqValid) begin
+        if (reqValid || is_pending) begin
           icache_reqValid = 1'b1;
           next_state      = IFU_WAIT_ICACHE;
           if (icache_respValid) begin
@@ -72,42 +220,89 @@ module ifu (
               respValid  = 1'b1;
               next_state = IFU_IDLE;
             end
+            else if (is_pf_hit) begin
+              inst                = pf_data[pc_offset];
+              respValid           = 1'b1;
+              icache_refill_start = 1'b1;
+              next_state          = IFU_FILL;
+            end
             else begin
-              io_reqValid = 1'b1;
-              next_state  = IFU_WAIT_IO;
+              io_reqValid         = 1'b1;
+              io_addr             = pc;
+              icache_refill_start = 1'b1;
+              next_state          = IFU_REFILL;
             end
           end
         end
       end
       IFU_WAIT_ICACHE: begin
+        icache_reqValid = 1'b1;
         if (icache_respValid) begin
           if (icache_hit) begin
             inst       = icache_rdata;
             respValid  = 1'b1;
             next_state = IFU_IDLE;
           end
+          else if (is_pf_hit) begin
+            inst                = pf_data[pc_offset];
+            respValid           = 1'b1;
+            icache_refill_start = 1'b1;
+            next_state          = IFU_FILL;
+          end
           else begin
-            io_reqValid = 1'b1;
-            next_state  = IFU_WAIT_IO;
+            io_reqValid         = 1'b1;
+            io_addr             = pc;
+            icache_refill_start = 1'b1;
+            next_state          = IFU_REFILL;
           end
         end
       end
-      IFU_WAIT_IO: begin
+      IFU_REFILL: begin
+        io_reqValid = is_refill_req;
         if (io_respValid) begin
-          inst            = io_rdata;
-          respValid       = 1'b1;
-       // next_state      = IFU_WRITE_ICACHE; TODO: right now we switch to IDLE right away, but if icache write takes more than 1 cycle, it is a bug.
-          next_state      = IFU_IDLE;
-          icache_wen      = 1'b1;
-          icache_reqValid = 1'b1;
+          icache_wen = 1'b1;
+          if (is_critical || ((reqValid || is_pending) && pc[31:2] == {refill_line, refill_offset})) begin
+            inst      = io_rdata;
+            respValid = 1'b1;
+          end
+          if (refill_words == (OFFSET_W+1)'(ICACHE_LINE_WORDS - 1)) begin
+            icache_refill_end = 1'b1;
+            next_state        = is_pf_next ? IFU_PREFETCH : IFU_IDLE;
+          end
         end
       end
-      IFU_WRITE_ICACHE: begin
-      // TODO: icache and io should be separate buses?
-        if (icache_respValid) begin
-          next_state   = IFU_IDLE;
+      IFU_PREFETCH: begin
+        io_reqValid     = is_pf_req && !is_pf_stop && !is_pf_abort && !is_lsu_busy;
+        io_addr         = {pf_line, pf_req_words[OFFSET_W-1:0], 2'b00};
+        icache_reqValid = is_fetch;
+        if (icache_hit) begin
+          inst      = icache_rdata;
+          respValid = 1'b1;
+        end
+        else if (is_fetch && io_respValid && pc[31:2] == {pf_line, pf_offset}) begin
+          inst      = io_rdata;
+          respValid = 1'b1;
+        end
+        if (io_respValid && is_pf_last) begin
+          next_state = IFU_IDLE;
+        end
+        else if ((is_pf_stop || is_pf_abort) && pf_req_words == pf_words_next) begin
+          next_state = IFU_IDLE;
         end
       end
+      IFU_FILL: begin
+        icache_wen = 1'b1;
+        if (is_fetch && pc_line == refill_line) begin
+          inst      = pf_data[pc_offset];
+          respValid = 1'b1;
+        end
+        if (refill_words == (OFFSET_W+1)'(ICACHE_LINE_WORDS - 1)) begin
+          icache_refill_end = 1'b1;
+          next_state        = is_pf_next ? IFU_PREFETCH : IFU_IDLE;
+        end
+      end
+      default: begin
+      end
     endcase
   end
 
@@ -119,8 +314,10 @@ always @ * begin
   case (curr_state)
     IFU_IDLE         : dbg_ifu = "IFU_IDLE";
     IFU_WAIT_ICACHE  : dbg_ifu = "IFU_WAIT_ICACHE";
-    IFU_WRITE_ICACHE : dbg_ifu = "IFU_WRITE_ICACHE";
-    IFU_WAIT_IO      : dbg_ifu = "IFU_WAIT_IO";
+    IFU_REFILL       : dbg_ifu = "IFU_REFILL";
+    IFU_PREFETCH     : dbg_ifu = "IFU_PREFETCH";
+    IFU_FILL         : dbg_ifu = "IFU_FILL";
+    default          : dbg_ifu = "IFU_UNDEFINED";
   endcase
 end
 /* verilator lint_on UNUSEDSIGNAL */
@@ -0,0 +1,123 @@
+// NOTE: the fetch of RV32C, between the core and the ifu. The core fetches at a 2-aligned pc and gets
+// the 32 bits at it, a 16-bit instruction in the low half; the ifu fetches words. The last word fetched
+// is kept: an instruction in it is answered without a fetch, so two 16-bit instructions cost one fetch.
+// A 32-bit instruction at pc[1] straddles two words, its upper half is fetched from the next word after
+// the lower one came; the next word is kept then, it holds the instruction after.
+module ifu_align (
+  input  logic        clock,
+  input  logic        reset,
+
+/* verilator lint_off UNUSEDSIGNAL */
+  input  logic [31:0] pc, // pc[0] is not used
+/* verilator lint_on UNUSEDSIGNAL */
+  input  logic        reqValid,
+  output logic        respValid,
+  output logic [31:0] inst,
+
+  output logic [31:0] word_pc,
+  output logic        word_reqValid,
+  input  logic        word_respValid,
+  input  logic [31:0] word_inst);
+
+  logic        buf_valid;
+  logic [31:2] buf_addr;
+  logic [31:0] buf_data;
+
+  logic        is_buf_hit;
+  logic        is_lo_resp;
+  logic        is_lo_ready;
+  logic        is_straddle;
+  logic        is_hi_req;
+  logic [31:0] lo_word;
+
+  typedef enum logic [1:0] {
+    ALIGN_IDLE, ALIGN_LO, ALIGN_HI
+  } align_state;
+
+  align_state next_state;
+  align_state curr_state;
+
+  assign is_buf_hit = buf_valid && buf_addr == pc[31:2];
+  assign word_pc    = curr_state == ALIGN_HI ? {pc[31:2] + 1'b1, 2'b00} : {pc[31:2], 2'b00};
+
+  // NOTE: the word at pc is ready when it is in the buffer or when the ifu answers it,
+  // in the cycle of the request or after
+  assign is_lo_resp  = word_respValid && (curr_state == ALIGN_LO || (curr_state == ALIGN_IDLE && reqValid && !is_buf_hit));
+  assign is_lo_ready = (curr_state == ALIGN_IDLE && reqValid && is_buf_hit) || is_lo_resp;
+  assign lo_word     = is_lo_resp ? word_inst : buf_data;
+  assign is_straddle = pc[1] && lo_word[17:16] == 2'b11;
+
+  always_comb begin
+    next_state    = curr_state;
+    respValid     = 1'b0;
+    inst          = 32'b0;
+    word_reqValid = 1'b0;
+    case (curr_state)
+      ALIGN_IDLE: begin
+        word_reqValid = reqValid && !is_buf_hit;
+        if (word_reqValid) begin
+          next_state = ALIGN_LO;
+        end
+      end
+      ALIGN_LO: begin
+      end
+      ALIGN_HI: begin
+        word_reqValid = is_hi_req;
+        if (word_respValid) begin
+          respValid  = 1'b1;
+          inst       = {word_inst[15:0], buf_data[31:16]};
+          next_state = ALIGN_IDLE;
+        end
+      end
+      default: begin
+        next_state = ALIGN_IDLE;
+      end
+    endcase
+    if (is_lo_ready && is_straddle) begin
+      next_state = ALIGN_HI;
+    end
+    else if (is_lo_ready) begin
+      respValid  = 1'b1;
+      inst       = pc[1] ? {16'b0, lo_word[31:16]} : lo_word;
+      next_state = ALIGN_IDLE;
+    end
+  end
+
+  // NOTE: the request of the next word is a registered pulse, like the fetch request of the core
+  always_ff @(posedge clock or posedge reset) begin
+    if (reset) begin
+      curr_state <= ALIGN_IDLE;
+      buf_valid  <= 1'b0;
+      is_hi_req  <= 1'b0;
+    end
+    else begin
+      curr_state <= next_state;
+      is_hi_req  <= is_lo_ready && is_straddle;
+      if (is_lo_resp) begin
+        buf_valid <= 1'b1;
+        buf_addr  <= pc[31:2];
+        buf_data  <= word_inst;
+      end
+      else if (curr_state == ALIGN_HI && word_respValid) begin
+        buf_addr  <= pc[31:2] + 1'b1;
+        buf_data  <= word_inst;
+      end
+    end
+  end
+
+`ifdef verilator
+/* verilator lint_off UNUSEDSIGNAL */
+reg [127:0]  dbg_align;
+
+always @ * begin
+  case (curr_state)
+    ALIGN_IDLE : dbg_align = "ALIGN_IDLE";
+    ALIGN_LO   : dbg_align = "ALIGN_LO";
+    ALIGN_HI   : dbg_align = "ALIGN_HI";
+    default    : dbg_align = "ALIGN_UNDEFINED";
+  endcase
+end
+/* verilator lint_on UNUSEDSIGNAL */
+`endif
+
+endmodule
@@ -0,0 +1,167 @@
+#include <cstdint>
+#include <cstdio>
+
+// NOTE: time series of the event counters, one CSV row every <period> cycles or instructions.
+// The rows are taken between instructions, so an interval ends on the first retire after its boundary.
+enum IntervalUnit {
+  Interval_Cycles,
+  Interval_Insts,
+};
+
+static const char* interval_unit_names[] = { "cycles", "insts" };
+
+struct IntervalSample {
+  uint64_t mcycle;
+  uint64_t minstret;
+  uint64_t mifu_wait;
+  uint64_t mlsu_wait;
+  uint64_t mload_seen;
+  uint64_t mstore_seen;
+  uint64_t msystem_seen;
+  uint64_t mcalc_seen;
+  uint64_t mjump_seen;
+  uint64_t mbranch_seen;
+  uint64_t mbranch_taken;
+  uint64_t micache_hits;
+  uint64_t micache_misses;
+  uint64_t micache_refills;
+  uint64_t mbranch_mispredicts;
+  uint64_t mbtb_hits;
+  uint64_t mdcache_hits;
+  uint64_t mdcache_misses;
+  uint64_t mdcache_writebacks;
+  uint64_t mprefetch_useful;
+  uint64_t mprefetch_useless;
+  uint64_t mfused;
+};
+
+struct IntervalStat {
+  FILE*          file;
+  IntervalUnit   unit;
+  uint64_t       period;
+  uint64_t       next;
+  uint64_t       index;
+  IntervalSample last;
+};
+
+bool interval_parse(const char* name, IntervalUnit* unit) {
+  for (uint32_t i = 0; i <= Interval_Insts; i++) {
+    if (strcmp(name, interval_unit_names[i]) == 0) {
+      *unit = (IntervalUnit)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool interval_open(IntervalStat* stat, const char* path, IntervalUnit unit, uint64_t period) {
+  *stat = {};
+  stat->unit   = unit;
+  stat->period = period;
+  stat->file   = fopen(path, "w");
+  if (!stat->file) return false;
+  fprintf(stat->file,
+          "interval,mcycle,minstret,cycles,insts,ipc,cpi,cpi ifu wait,cpi lsu wait,cpi exec,"
+          "load seen,store seen,system seen,calc seen,jump seen,branch seen,branch taken,icache hits,icache hit rate,"
+          "icache misses,icache refill cycles,branch mispredicts,btb hits,"
+          "dcache hits,dcache misses,dcache writebacks,prefetch useful,prefetch useless,fused pairs\n");
+  return true;
+}
+
+void interval_close(IntervalStat* stat) {
+  if (stat->file) fclose(stat->file);
+  stat->file = NULL;
+}
+
+IntervalSample interval_take(VEventCounts* counts) {
+  return {
+    .mcycle          = counts->mcycle,
+    .minstret        = counts->minstret,
+    .mifu_wait       = counts->mifu_wait,
+    .mlsu_wait       = counts->mlsu_wait,
+    .mload_seen      = counts->mload_seen,
+    .mstore_seen     = counts->mstore_seen,
+    .msystem_seen    = counts->msystem_seen,
+    .mcalc_seen      = counts->mcalc_seen,
+    .mjump_seen      = counts->mjump_seen,
+    .mbranch_seen    = counts->mbranch_seen,
+    .mbranch_taken   = counts->mbranch_taken,
+    .micache_hits    = counts->micache_hits,
+    .micache_misses  = counts->micache_misses,
+    .micache_refills = counts->micache_refills,
+    .mbranch_mispredicts = counts->mbranch_mispredicts,
+    .mbtb_hits           = counts->mbtb_hits,
+    .mdcache_hits        = counts->mdcache_hits,
+    .mdcache_misses      = counts->mdcache_misses,
+    .mdcache_writebacks  = counts->mdcache_writebacks,
+    .mprefetch_useful    = counts->mprefetch_useful,
+    .mprefetch_useless   = counts->mprefetch_useless,
+    .mfused              = counts->mfused,
+  };
+}
+
+uint64_t interval_position(IntervalStat* stat, IntervalSample* sample) {
+  return stat->unit == Interval_Cycles ? sample->mcycle : sample->minstret;
+}
+
+// NOTE: the counters restart with the cpu reset
+void interval_reset(IntervalStat* stat, VEventCounts* counts) {
+  stat->last = interval_take(counts);
+  stat->next = interval_position(stat, &stat->last) + stat->period;
+}
+
+void interval_write(IntervalStat* stat, IntervalSample* now) {
+  IntervalSample* last = &stat->last;
+  uint64_t cycles  = now->mcycle   - last->mcycle;
+  uint64_t insts   = now->minstret - last->minstret;
+  uint64_t ifu     = now->mifu_wait - last->mifu_wait;
+  uint64_t lsu     = now->mlsu_wait - last->mlsu_wait;
+  uint64_t hits    = now->micache_hits   - last->micache_hits;
+  uint64_t misses  = now->micache_misses - last->micache_misses;
+  double   cpi     = insts ? (double)cycles / insts : 0.0;
+  double   cpi_ifu = insts ? (double)ifu    / insts : 0.0;
+  double   cpi_lsu = insts ? (double)lsu    / insts : 0.0;
+  // NOTE: the hit rate is per icache lookup, an RVC pair in one word, a multi-word line and the prefetch
+  // make lookups differ from the retired instructions
+  fprintf(stat->file, "%lu,%lu,%lu,%lu,%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.4f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+          stat->index,
+          now->mcycle,
+          now->minstret,
+          cycles,
+          insts,
+          cycles ? (double)insts / cycles : 0.0,
+          cpi,
+          cpi_ifu,
+          cpi_lsu,
+          cpi - cpi_ifu - cpi_lsu,
+          now->mload_seen    - last->mload_seen,
+          now->mstore_seen   - last->mstore_seen,
+          now->msystem_seen  - last->msystem_seen,
+          now->mcalc_seen    - last->mcalc_seen,
+          now->mjump_seen    - last->mjump_seen,
+          now->mbranch_seen  - last->mbranch_seen,
+          now->mbranch_taken - last->mbranch_taken,
+          hits,
+          hits + misses ? (double)hits / (hits + misses) : 0.0,
+          misses,
+          now->micache_refills - last->micache_refills,
+          now->mbranch_mispredicts - last->mbranch_mispredicts,
+          now->mbtb_hits           - last->mbtb_hits,
+          now->mdcache_hits        - last->mdcache_hits,
+          now->mdcache_misses      - last->mdcache_misses,
+          now->mdcache_writebacks  - last->mdcache_writebacks,
+          now->mprefetch_useful    - last->mprefetch_useful,
+          now->mprefetch_useless   - last->mprefetch_useless,
+          now->mfused              - last->mfused);
+  stat->index++;
+  stat->last = *now;
+}
+
+// NOTE: is_final writes the partial interval at the end of a test
+void interval_sample(IntervalStat* stat, VEventCounts* counts, bool is_final) {
+  IntervalSample now = interval_take(counts);
+  uint64_t position = interval_position(stat, &now);
+  if (position < stat->next && !(is_final && position > interval_position(stat, &stat->last))) return;
+  interval_write(stat, &now);
+  while (stat->next <= position) stat->next += stat->period;
+}
@@ -0,0 +1,249 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <elf.h>
+
+// NOTE: host execution of the klib string routines for the gold model running alone.
+// On the entry of a known routine the gold model does the whole call on its memory and returns to ra,
+// the call counts as one instruction. The minirv lowering of the routines spills to the stack below sp,
+// those scratch bytes are not written. A call whose buffers are not all in mem (or flash, when read only)
+// is left to the simulated routine.
+enum KlibFunc {
+  Klib_Memcpy,
+  Klib_Memmove,
+  Klib_Memset,
+  Klib_Memcmp,
+  Klib_Strlen,
+  Klib_Strcpy,
+  Klib_Strcmp,
+  Klib_Strncmp,
+  Klib_Count,
+};
+
+static const char* klib_func_names[] = { "memcpy", "memmove", "memset", "memcmp", "strlen", "strcpy", "strcmp", "strncmp" };
+
+struct KlibNative {
+  uint32_t addrs[Klib_Count];
+  bool     is_found[Klib_Count];
+  uint64_t calls[Klib_Count];
+  uint64_t bytes[Klib_Count];
+  uint64_t fallbacks[Klib_Count];
+  uint32_t found;
+};
+
+static bool klib_add(KlibNative* klib, const char* name, uint32_t addr) {
+  for (uint32_t f = 0; f < Klib_Count; f++) {
+    if (strcmp(name, klib_func_names[f]) == 0) {
+      if (!klib->is_found[f]) klib->found++;
+      klib->addrs[f]    = addr;
+      klib->is_found[f] = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+// NOTE: the function symbols of the .symtab of an ELF32 little endian image
+static bool klib_load_elf(KlibNative* klib, uint8_t* data, size_t size) {
+  if (size < sizeof(Elf32_Ehdr)) return false;
+  Elf32_Ehdr* ehdr = (Elf32_Ehdr*)data;
+  if (ehdr->e_ident[EI_CLASS] != ELFCLASS32 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB) return false;
+  if (ehdr->e_shoff + (size_t)ehdr->e_shnum * sizeof(Elf32_Shdr) > size) return false;
+  Elf32_Shdr* shdrs = (Elf32_Shdr*)(data + ehdr->e_shoff);
+  for (uint32_t i = 0; i < ehdr->e_shnum; i++) {
+    Elf32_Shdr* symtab = &shdrs[i];
+    if (symtab->sh_type != SHT_SYMTAB || symtab->sh_link >= ehdr->e_shnum) continue;
+    Elf32_Shdr* strtab = &shdrs[symtab->sh_link];
+    if (symtab->sh_offset + (size_t)symtab->sh_size > size || strtab->sh_offset + (size_t)strtab->sh_size > size) return false;
+    Elf32_Sym* syms = (Elf32_Sym*)(data + symtab->sh_offset);
+    char*      strs = (char*)(data + strtab->sh_offset);
+    for (uint32_t s = 0; s < symtab->sh_size / sizeof(Elf32_Sym); s++) {
+      if (ELF32_ST_TYPE(syms[s].st_info) != STT_FUNC || syms[s].st_name >= strtab->sh_size) continue;
+      klib_add(klib, strs + syms[s].st_name, syms[s].st_value);
+    }
+  }
+  return true;
+}
+
+// NOTE: otherwise one "<name> <address>" per line
+static bool klib_load_list(KlibNative* klib, uint8_t* data, size_t size) {
+  char* text = (char*)data;
+  size_t at = 0;
+  while (at < size) {
+    char line[128] = {};
+    size_t n = 0;
+    while (at < size && text[at] != '\n') {
+      if (n + 1 < sizeof(line)) line[n++] = text[at];
+      at++;
+    }
+    at++;
+    char name[64];
+    uint32_t addr = 0;
+    if (line[0] == '#' || sscanf(line, "%63s %x", name, &addr) != 2) continue;
+    if (!klib_add(klib, name, addr)) return false;
+  }
+  return true;
+}
+
+bool klib_load(KlibNative* klib, const char* path) {
+  *klib = {};
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t* data = (uint8_t*)malloc(size > 0 ? size : 1);
+  bool is_read = size > 0 && fread(data, 1, size, f) == (size_t)size;
+  fclose(f);
+  bool result = false;
+  if (is_read) {
+    bool is_elf = size >= SELFMAG && memcmp(data, ELFMAG, SELFMAG) == 0;
+    result = is_elf ? klib_load_elf(klib, data, size) : klib_load_list(klib, data, size);
+  }
+  free(data);
+  return result && klib->found;
+}
+
+// NOTE: host pointer to <size> bytes at <addr>, NULL when they are not all in one memory
+static uint8_t* klib_host(Gcpu* cpu, uint32_t addr, uint32_t size, bool is_write) {
+  if (addr >= MEM_START && addr < MEM_END && size <= MEM_END - addr) {
+    return &cpu->mem[addr - MEM_START];
+  }
+  if (!is_write && addr >= FLASH_START && addr < FLASH_END && size <= FLASH_END - addr) {
+    return &cpu->flash[addr - FLASH_START];
+  }
+  return NULL;
+}
+
+// NOTE: length of the string at <addr> without its terminator, -1 when it leaves its memory
+static int64_t klib_host_strlen(Gcpu* cpu, uint32_t addr) {
+  uint8_t* s = klib_host(cpu, addr, 1, false);
+  if (!s) return -1;
+  uint32_t room = (addr >= MEM_START ? MEM_END : FLASH_END) - addr;
+  uint8_t* end  = (uint8_t*)memchr(s, 0, room);
+  return end ? end - s : -1;
+}
+
+static bool klib_is_overlap(uint32_t a, uint32_t b, uint32_t size) {
+  return a < b + size && b < a + size;
+}
+
+static int32_t klib_diff(uint8_t* a, uint8_t* b, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    if (a[i] != b[i]) return (int32_t)a[i] - (int32_t)b[i];
+  }
+  return 0;
+}
+
+// NOTE: runs the call when the gold pc is at a known routine, returns false to let the model execute it
+bool klib_call(KlibNative* klib, Gcpu* cpu) {
+  int32_t func = -1;
+  for (uint32_t f = 0; f < Klib_Count; f++) {
+    if (klib->is_found[f] && klib->addrs[f] == cpu->pc) {
+      func = f;
+      break;
+    }
+  }
+  if (func < 0) return false;
+
+  uint32_t a0 = cpu->regs[10];
+  uint32_t a1 = cpu->regs[11];
+  uint32_t a2 = cpu->regs[12];
+  uint32_t result = a0;
+  uint64_t bytes  = 0;
+  bool     is_done = false;
+  switch (func) {
+    case Klib_Memcpy:
+    case Klib_Memmove: {
+      uint8_t* dst = klib_host(cpu, a0, a2, true);
+      uint8_t* src = klib_host(cpu, a1, a2, false);
+      // NOTE: the forward copy of memcpy repeats the source on an overlap, memmove does not
+      if (dst && src && (func == Klib_Memmove || !klib_is_overlap(a0, a1, a2))) {
+        memmove(dst, src, a2);
+        bytes = a2;
+        is_done = true;
+      }
+    } break;
+    case Klib_Memset: {
+      uint8_t* dst = klib_host(cpu, a0, a2, true);
+      if (dst) {
+        memset(dst, a1 & 0xff, a2);
+        bytes = a2;
+        is_done = true;
+      }
+    } break;
+    case Klib_Memcmp: {
+      uint8_t* lhs = klib_host(cpu, a0, a2, false);
+      uint8_t* rhs = klib_host(cpu, a1, a2, false);
+      if (lhs && rhs) {
+        result = klib_diff(lhs, rhs, a2);
+        bytes = a2;
+        is_done = true;
+      }
+    } break;
+    case Klib_Strlen: {
+      int64_t len = klib_host_strlen(cpu, a0);
+      if (len >= 0) {
+        result = len;
+        bytes = len + 1;
+        is_done = true;
+      }
+    } break;
+    case Klib_Strcpy: {
+      int64_t  len = klib_host_strlen(cpu, a1);
+      uint8_t* dst = len >= 0 ? klib_host(cpu, a0, len + 1, true) : NULL;
+      if (dst && !klib_is_overlap(a0, a1, len + 1)) {
+        memcpy(dst, klib_host(cpu, a1, len + 1, false), len + 1);
+        bytes = len + 1;
+        is_done = true;
+      }
+    } break;
+    case Klib_Strcmp:
+    case Klib_Strncmp: {
+      int64_t lhs_len = klib_host_strlen(cpu, a0);
+      int64_t rhs_len = klib_host_strlen(cpu, a1);
+      if (lhs_len >= 0 && rhs_len >= 0) {
+        // NOTE: the bytes up to the first difference or terminator decide, at most n for strncmp
+        uint64_t n = (lhs_len < rhs_len ? lhs_len : rhs_len) + 1;
+        if (func == Klib_Strncmp && a2 < n) n = a2;
+        result = klib_diff(klib_host(cpu, a0, n, false), klib_host(cpu, a1, n, false), n);
+        bytes = n;
+        is_done = true;
+      }
+    } break;
+  }
+  if (!is_done) {
+    klib->fallbacks[func]++;
+    if (cpu->verbose >= VerboseInfo5) {
+      printf("[INFO5] klib %s(0x%x, 0x%x, 0x%x) simulated\n", klib_func_names[func], a0, a1, a2);
+    }
+    return false;
+  }
+  if (cpu->verbose >= VerboseInfo5) {
+    printf("[INFO5] klib %s(0x%x, 0x%x, 0x%x) = 0x%x native, %lu bytes\n", klib_func_names[func], a0, a1, a2, result, bytes);
+  }
+  klib->calls[func]++;
+  klib->bytes[func] += bytes;
+  cpu->regs[10] = result;
+  cpu->pc = cpu->regs[1] & ~1;
+  cpu->ebreak = 0;
+  cpu->is_csr_timing = false;
+  cpu->is_mem_write = false;
+  cpu->minstret++;
+  return true;
+}
+
+void klib_print(KlibNative* klib) {
+  printf("[INFO] gold klib native calls:\n");
+  printf("  %-8s %10s %12s %12s %10s\n", "routine", "address", "calls", "bytes", "simulated");
+  for (uint32_t f = 0; f < Klib_Count; f++) {
+    if (!klib->is_found[f]) continue;
+    printf("  %-8s 0x%08x %12lu %12lu %10lu\n",
+           klib_func_names[f],
+           klib->addrs[f],
+           klib->calls[f],
+           klib->bytes[f],
+           klib->fallbacks[f]);
+  }
+}
@@ -0,0 +1,154 @@
+#include <cstdint>
+#include <cstdio>
+#include "mem_map.h"
+
+// NOTE: latency histograms of the IFU fetches and LSU accesses, as seen by the core:
+// cycles from the reqValid of the IFU/LSU to their respValid, 0 when answered in the request cycle.
+// A fetch without a bus request is an icache hit, a misaligned LSU access is split in two bus requests.
+#define LAT_BUCKETS (1024) // the last bucket counts every latency >= LAT_BUCKETS-1
+
+enum LatKind {
+  LatKind_IfuHit,
+  LatKind_IfuMiss,
+  LatKind_Load,
+  LatKind_Store,
+  LatKind_LoadSplit,
+  LatKind_StoreSplit,
+  LatKind_Count,
+};
+
+enum LatRegion {
+  LatRegion_Flash,
+  LatRegion_Mem,
+  LatRegion_Uart,
+  LatRegion_Other,
+  LatRegion_Count,
+};
+
+static const char* lat_kind_names[]   = { "ifu hit", "ifu miss", "load", "store", "load split", "store split" };
+static const char* lat_region_names[] = { "flash", "mem", "uart", "other" };
+
+// NOTE: the core signals of one cycle, sampled right before its posedge
+struct LatSignals {
+  uint8_t  ifu_reqValid;
+  uint8_t  ifu_respValid;
+  uint8_t  io_ifu_reqValid;
+  uint32_t pc;
+  uint8_t  lsu_reqValid;
+  uint8_t  lsu_respValid;
+  uint8_t  is_store;
+  uint8_t  is_misalign;
+  uint32_t lsu_addr;
+};
+
+struct LatHist {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[LAT_BUCKETS];
+};
+
+struct LatRequest {
+  bool     is_busy;
+  uint64_t start;
+  uint32_t addr;
+  bool     is_store;
+  bool     is_split;
+  uint32_t bus_requests;
+};
+
+struct LatStat {
+  LatHist    hists[LatKind_Count][LatRegion_Count];
+  LatRequest ifu;
+  LatRequest lsu;
+};
+
+LatRegion lat_region(uint32_t addr) {
+  if (addr >= FLASH_START && addr < FLASH_END) return LatRegion_Flash;
+  if (addr >= MEM_START   && addr < MEM_END)   return LatRegion_Mem;
+  if (addr >= UART_START  && addr < UART_END)  return LatRegion_Uart;
+  return LatRegion_Other;
+}
+
+void lat_put(LatStat* stat, LatKind kind, uint32_t addr, uint64_t latency) {
+  LatHist* hist = &stat->hists[kind][lat_region(addr)];
+  hist->count++;
+  hist->sum += latency;
+  if (latency > hist->max) hist->max = latency;
+  hist->buckets[latency < LAT_BUCKETS ? latency : LAT_BUCKETS - 1]++;
+}
+
+// NOTE: the pending requests do not survive a cpu reset
+void lat_reset(LatStat* stat) {
+  stat->ifu = {};
+  stat->lsu = {};
+}
+
+// NOTE: the cycles skipped by the testbench move the start of the pending requests
+void lat_shift(LatStat* stat, uint64_t cycles) {
+  stat->ifu.start += cycles;
+  stat->lsu.start += cycles;
+}
+
+void lat_sample(LatStat* stat, uint64_t cycle, LatSignals* s) {
+  LatRequest* ifu = &stat->ifu;
+  if (!ifu->is_busy && s->ifu_reqValid) {
+    *ifu = {};
+    ifu->is_busy = true;
+    ifu->start   = cycle;
+    ifu->addr    = s->pc;
+  }
+  if (ifu->is_busy && s->io_ifu_reqValid) {
+    ifu->bus_requests++;
+  }
+  if (ifu->is_busy && s->ifu_respValid) {
+    lat_put(stat, ifu->bus_requests ? LatKind_IfuMiss : LatKind_IfuHit, ifu->addr, cycle - ifu->start);
+    ifu->is_busy = false;
+  }
+
+  LatRequest* lsu = &stat->lsu;
+  if (!lsu->is_busy && s->lsu_reqValid) {
+    *lsu = {};
+    lsu->is_busy  = true;
+    lsu->start    = cycle;
+    lsu->addr     = s->lsu_addr;
+    lsu->is_store = s->is_store;
+    lsu->is_split = s->is_misalign;
+  }
+  if (lsu->is_busy && s->lsu_respValid) {
+    LatKind kind = lsu->is_store ? (lsu->is_split ? LatKind_StoreSplit : LatKind_Store)
+                                 : (lsu->is_split ? LatKind_LoadSplit  : LatKind_Load);
+    lat_put(stat, kind, lsu->addr, cycle - lsu->start);
+    lsu->is_busy = false;
+  }
+}
+
+uint64_t lat_percentile(LatHist* hist, double p) {
+  uint64_t rank = (uint64_t)(p * (hist->count - 1));
+  uint64_t seen = 0;
+  for (uint64_t i = 0; i < LAT_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen > rank) return i;
+  }
+  return LAT_BUCKETS - 1;
+}
+
+void lat_print(LatStat* stat, const char* cpu_name) {
+  printf("[INFO] %s request latency, cycles:\n", cpu_name);
+  printf("  %-12s %-6s %12s %9s %6s %6s %6s %6s\n", "kind", "region", "count", "mean", "p50", "p90", "p99", "max");
+  for (uint32_t k = 0; k < LatKind_Count; k++) {
+    for (uint32_t r = 0; r < LatRegion_Count; r++) {
+      LatHist* hist = &stat->hists[k][r];
+      if (!hist->count) continue;
+      printf("  %-12s %-6s %12lu %9.2f %6lu %6lu %6lu %6lu\n",
+             lat_kind_names[k],
+             lat_region_names[r],
+             hist->count,
+             (double)hist->sum / hist->count,
+             lat_percentile(hist, 0.50),
+             lat_percentile(hist, 0.90),
+             lat_percentile(hist, 0.99),
+             hist->max);
+    }
+  }
+}
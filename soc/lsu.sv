@@ -1,3 +1,4 @@
+`include "core_defines.vh"
 module lsu (
   input logic         clock,
   input logic         reset,
@@ -18,7 +19,23 @@ module lsu (
   output logic [31:0] io_addr,
   output logic [1:0]  io_size,
   output logic        io_wen,
-  output logic [3:0]  io_wmask);
+  output logic [3:0]  io_wmask,
+
+  output logic        is_busy,
+  output logic        is_dcache_hit,
+  output logic        is_dcache_miss,
+  output logic        is_dcache_writeback);
+
+  // NOTE: the bus port of the lsu, on io_* directly or through the dcache (DCACHE=1 ./build_run.sh)
+  logic        bus_reqValid;
+  logic        bus_respValid /* verilator public_flat_rd */;
+  logic [31:0] bus_wdata;
+  logic [31:0] bus_rdata;
+  logic [31:0] bus_addr;
+  logic [1:0]  bus_size;
+  logic        bus_wen;
+  logic [3:0]  bus_wmask;
+  logic        is_bus_busy;
 
   localparam LSU_BYTE = 2'b00;
   localparam LSU_HALF = 2'b01;
@@ -33,64 +50,64 @@ module lsu (
   logic        mem_half_sign;
   logic [23:0] mem_byte_extend;
   logic [15:0] mem_half_extend;
-  logic        is_misalign;
+  logic        is_misalign /* verilator public_flat_rd */;
   logic        is_second_part;
   logic        is_read;
 
   assign is_misalign = (addr_offset != 2'b00 && data_size == LSU_WORD) ||
                        (addr_offset == 2'b11 && data_size == LSU_HALF) ;;
   assign addr_offset = addr[1:0];
-  assign io_addr     = is_second_part ? {addr[31:2]+29'b1, 2'b00} : addr;
-  assign io_size     = data_size;
-  assign io_wen      = is_write;
+  assign bus_addr    = is_second_part ? {addr[31:2]+29'b1, 2'b00} : addr;
+  assign bus_size    = data_size;
+  assign bus_wen     = is_write;
   assign is_read     = ~is_write;
 
   always_comb begin
     case (addr_offset)
-      2'b00: io_wdata =  wdata[31:0];
-      2'b01: io_wdata = {wdata[23:0], wdata[31:24]};
-      2'b10: io_wdata = {wdata[15:0], wdata[31:16]};
-      2'b11: io_wdata = {wdata[ 7:0], wdata[31: 8]};
+      2'b00: bus_wdata =  wdata[31:0];
+      2'b01: bus_wdata = {wdata[23:0], wdata[31:24]};
+      2'b10: bus_wdata = {wdata[15:0], wdata[31:16]};
+      2'b11: bus_wdata = {wdata[ 7:0], wdata[31: 8]};
     endcase
 
     case (data_size)
       LSU_BYTE: begin
         case (addr_offset)
-          2'b00: io_wmask = 4'b0001;
-          2'b01: io_wmask = 4'b0010;
-          2'b10: io_wmask = 4'b0100;
-          2'b11: io_wmask = 4'b1000;
+          2'b00: bus_wmask = 4'b0001;
+          2'b01: bus_wmask = 4'b0010;
+          2'b10: bus_wmask = 4'b0100;
+          2'b11: bus_wmask = 4'b1000;
         endcase
       end
       LSU_HALF: begin
         if (is_second_part)
-          io_wmask = 4'b0001;
+          bus_wmask = 4'b0001;
         else
           case (addr_offset)
-            2'b00: io_wmask = 4'b0011;
-            2'b01: io_wmask = 4'b0110;
-            2'b10: io_wmask = 4'b1100;
-            2'b11: io_wmask = 4'b1000;
+            2'b00: bus_wmask = 4'b0011;
+            2'b01: bus_wmask = 4'b0110;
+            2'b10: bus_wmask = 4'b1100;
+            2'b11: bus_wmask = 4'b1000;
           endcase
       end
       LSU_WORD: begin
         if (is_second_part)
           case (addr_offset)
-            2'b00: io_wmask = 4'b1111;
-            2'b01: io_wmask = 4'b0001;
-            2'b10: io_wmask = 4'b0011;
-            2'b11: io_wmask = 4'b0111;
+            2'b00: bus_wmask = 4'b1111;
+            2'b01: bus_wmask = 4'b0001;
+            2'b10: bus_wmask = 4'b0011;
+            2'b11: bus_wmask = 4'b0111;
           endcase
         else
           case (addr_offset)
-            2'b00: io_wmask = 4'b1111;
-            2'b01: io_wmask = 4'b1110;
-            2'b10: io_wmask = 4'b1100;
-            2'b11: io_wmask = 4'b1000;
+            2'b00: bus_wmask = 4'b1111;
+            2'b01: bus_wmask = 4'b1110;
+            2'b10: bus_wmask = 4'b1100;
+            2'b11: bus_wmask = 4'b1000;
           endcase
       end
       LSU_EXTA: begin
-        io_wmask = 4'b1111;
+        bus_wmask = 4'b1111;
       end
     endcase
   end
@@ -100,17 +117,17 @@ module lsu (
       first_rdata_q  <= 24'b0;
     end
     else begin
-      if (is_read && io_respValid) begin
-        first_rdata_q  <= io_rdata[31:8];
+      if (is_read && bus_respValid) begin
+        first_rdata_q  <= bus_rdata[31:8];
       end
     end
   end
   always_comb begin
     case (addr_offset)
-      2'b00: align_rdata =  io_rdata[31:0];
-      2'b01: align_rdata = {io_rdata[ 7:0], first_rdata[31: 8]};
-      2'b10: align_rdata = {io_rdata[15:0], first_rdata[31:16]};
-      2'b11: align_rdata = {io_rdata[23:0], first_rdata[31:24]};
+      2'b00: align_rdata =  bus_rdata[31:0];
+      2'b01: align_rdata = {bus_rdata[ 7:0], first_rdata[31: 8]};
+      2'b10: align_rdata = {bus_rdata[15:0], first_rdata[31:16]};
+      2'b11: align_rdata = {bus_rdata[23:0], first_rdata[31:24]};
     endcase
   end
 
@@ -135,7 +152,7 @@ module lsu (
   lsu_state next_state;
   lsu_state curr_state;
   logic     io_reqValid_q;
-  logic     io_reqValid_d;
+  logic     io_reqValid_d /* verilator public_flat_rd */;
   always_ff @(posedge clock or posedge reset) begin
     if (reset) begin
       curr_state <= LSU_IDLE;
@@ -146,17 +163,19 @@ module lsu (
     end
   end
 
-  assign io_reqValid = io_reqValid_d | io_reqValid_q;
+  assign bus_reqValid = io_reqValid_d | io_reqValid_q;
+  // NOTE: the lsu, or the dcache behind it, waits for the bus; the ifu prefetch keeps off the bus meanwhile
+  assign is_busy      = curr_state != LSU_IDLE || is_bus_busy;
   always_comb begin
     io_reqValid_d  = 1'b0;
     respValid      = 1'b0;
     is_second_part = 1'b0;
-    first_rdata    = io_rdata[31:8];
+    first_rdata    = bus_rdata[31:8];
     case (curr_state)
       LSU_IDLE: begin
         if (reqValid) begin
           io_reqValid_d   = 1'b1;
-          if (io_respValid) begin
+          if (bus_respValid) begin
             respValid      = ~is_misalign;
             next_state     = is_misalign ? LSU_WAIT_MIS_TWO : LSU_IDLE;
           end
@@ -169,7 +188,7 @@ module lsu (
         end
       end
       LSU_WAIT_ONE: begin
-        if (io_respValid) begin
+        if (bus_respValid) begin
           next_state = LSU_IDLE;
           respValid  = 1'b1;
         end
@@ -179,7 +198,7 @@ module lsu (
       end
       LSU_WAIT_MIS_TWO: begin
         is_second_part = 1'b1;
-        if (io_respValid) begin
+        if (bus_respValid) begin
           next_state  = LSU_IDLE;
           first_rdata = first_rdata_q;
           respValid   = 1'b1;
@@ -189,7 +208,7 @@ module lsu (
         end
       end
       LSU_WAIT_MIS_ONE: begin
-        if (io_respValid) begin
+        if (bus_respValid) begin
           is_second_part = 1'b1;
           io_reqValid_d    = 1'b1;
           respValid      = 1'b0;
@@ -205,6 +224,59 @@ module lsu (
     endcase
   end
 
+`ifdef DCACHE
+/* verilator lint_off UNUSEDPARAM */
+`include "dcache_defines.vh"
+/* verilator lint_on UNUSEDPARAM */
+
+  dcache #(
+    .WAYS      (DCACHE_WAYS),
+    .SETS      (DCACHE_SETS),
+    .LINE_WORDS(DCACHE_LINE_WORDS),
+    .START     (DCACHE_START),
+    .END       (DCACHE_END)
+  ) u_dcache(
+    .clock(clock),
+    .reset(reset),
+
+    .reqValid    (bus_reqValid),
+    .respValid   (bus_respValid),
+    .addr        (bus_addr),
+    .size        (bus_size),
+    .wen         (bus_wen),
+    .wdata       (bus_wdata),
+    .wmask       (bus_wmask),
+    .rdata       (bus_rdata),
+
+    .io_reqValid (io_reqValid),
+    .io_respValid(io_respValid),
+    .io_addr     (io_addr),
+    .io_size     (io_size),
+    .io_wen      (io_wen),
+    .io_wdata    (io_wdata),
+    .io_wmask    (io_wmask),
+    .io_rdata    (io_rdata),
+
+    .is_busy     (is_bus_busy),
+    .is_hit      (is_dcache_hit),
+    .is_miss     (is_dcache_miss),
+    .is_writeback(is_dcache_writeback));
+`else
+  assign io_reqValid   = bus_reqValid;
+  assign bus_respValid = io_respValid;
+  assign io_addr       = bus_addr;
+  assign io_size       = bus_size;
+  assign io_wen        = bus_wen;
+  assign io_wdata      = bus_wdata;
+  assign io_wmask      = bus_wmask;
+  assign bus_rdata     = io_rdata;
+  assign is_bus_busy   = 1'b0;
+
+  assign is_dcache_hit       = 1'b0;
+  assign is_dcache_miss      = 1'b0;
+  assign is_dcache_writeback = 1'b0;
+`endif
+
 `ifdef verilator
 /* verilator lint_off UNUSEDSIGNAL */
 reg [159:0]  dbg_lsu;
@@ -0,0 +1,218 @@
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <queue>
+#include <vector>
+
+// NOTE: the vcpu bus agents are C++20 coroutines driven by a tick scheduler.
+// The scheduler is stepped once per testbench tick, right after the clock edge, and resumes
+// - the coroutines whose delay has expired,
+// - on a posedge, the coroutines waiting for one, or for one with their request line high.
+// Coroutines woken on the same tick run in the order of their priority, so the agents see
+// each other's effects in a fixed order. An idle agent stays parked on its request line,
+// a posedge without a request only tests that byte and resumes nothing.
+enum AgentPriority {
+  AgentPriority_IfuDrop,
+  AgentPriority_IfuSample,
+  AgentPriority_IfuRespond,
+  AgentPriority_LsuDrop,
+  AgentPriority_LsuSample,
+  AgentPriority_LsuRespond,
+};
+
+struct AgentTask {
+  struct promise_type {
+    AgentTask get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    // NOTE: started by the scheduler, frees itself when it returns
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never  final_suspend()   noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+  std::coroutine_handle<promise_type> handle;
+};
+
+struct AgentWake {
+  uint64_t tick;
+  uint32_t priority;
+  uint64_t seq;
+  std::coroutine_handle<> handle;
+};
+
+struct AgentWakeLater {
+  bool operator()(const AgentWake& a, const AgentWake& b) const {
+    if (a.tick     != b.tick)     return a.tick     > b.tick;
+    if (a.priority != b.priority) return a.priority > b.priority;
+    return a.seq > b.seq;
+  }
+};
+
+// NOTE: signal is the model output the waiter is parked on, NULL for any posedge
+struct AgentPosedgeWait {
+  uint32_t priority;
+  const uint8_t* signal;
+  std::coroutine_handle<> handle;
+};
+
+struct AgentScheduler {
+  uint64_t tick;
+  uint64_t seq;
+  std::priority_queue<AgentWake, std::vector<AgentWake>, AgentWakeLater> timers;
+  std::vector<AgentPosedgeWait> posedge_waiters;
+};
+
+void sched_wake(AgentScheduler* sched, uint64_t tick, uint32_t priority, std::coroutine_handle<> handle) {
+  sched->timers.push({tick, priority, sched->seq++, handle});
+}
+
+void sched_spawn(AgentScheduler* sched, uint32_t priority, AgentTask task) {
+  sched_wake(sched, sched->tick, priority, task.handle);
+}
+
+struct AgentDelay {
+  AgentScheduler* sched;
+  uint64_t ticks;
+  uint32_t priority;
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) { sched_wake(sched, sched->tick + ticks, priority, handle); }
+  void await_resume() const noexcept {}
+};
+
+struct AgentPosedge {
+  AgentScheduler* sched;
+  uint32_t priority;
+  const uint8_t* signal;
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) { sched->posedge_waiters.push_back({priority, signal, handle}); }
+  void await_resume() const noexcept {}
+};
+
+// NOTE: wait ticks on the scheduler, 0 still yields to the coroutines with a lower priority
+AgentDelay sched_delay(AgentScheduler* sched, uint64_t ticks, uint32_t priority) {
+  return {sched, ticks, priority};
+}
+
+// NOTE: wait for the next step that follows a rising edge
+AgentPosedge sched_posedge(AgentScheduler* sched, uint32_t priority) {
+  return {sched, priority, NULL};
+}
+
+// NOTE: wait for the next step that follows a rising edge with signal high
+AgentPosedge sched_posedge_until(AgentScheduler* sched, uint32_t priority, const uint8_t* signal) {
+  return {sched, priority, signal};
+}
+
+void sched_step(AgentScheduler* sched, bool is_posedge) {
+  if (is_posedge) {
+    size_t parked = 0;
+    for (AgentPosedgeWait& waiter : sched->posedge_waiters) {
+      if (waiter.signal && !*waiter.signal) {
+        sched->posedge_waiters[parked++] = waiter;
+        continue;
+      }
+      sched_wake(sched, sched->tick, waiter.priority, waiter.handle);
+    }
+    sched->posedge_waiters.resize(parked);
+  }
+  while (!sched->timers.empty() && sched->timers.top().tick <= sched->tick) {
+    std::coroutine_handle<> handle = sched->timers.top().handle;
+    sched->timers.pop();
+    handle.resume();
+  }
+  sched->tick++;
+}
+
+// NOTE: moves every pending wake up by ticks, the coroutines only keep relative delays
+void sched_shift(AgentScheduler* sched, uint64_t ticks) {
+  std::vector<AgentWake> wakes;
+  while (!sched->timers.empty()) {
+    wakes.push_back(sched->timers.top());
+    sched->timers.pop();
+  }
+  for (AgentWake& wake : wakes) {
+    wake.tick += ticks;
+    sched->timers.push(wake);
+  }
+  sched->tick += ticks;
+}
+
+// NOTE: every live agent coroutine is suspended in exactly one of the wait lists
+void sched_clear(AgentScheduler* sched) {
+  while (!sched->timers.empty()) {
+    sched->timers.top().handle.destroy();
+    sched->timers.pop();
+  }
+  for (AgentPosedgeWait& waiter : sched->posedge_waiters) {
+    waiter.handle.destroy();
+  }
+  sched->posedge_waiters.clear();
+  sched->tick = 0;
+  sched->seq  = 0;
+}
+
+#define MEM_AGENT_MAX_INFLIGHT (8)
+
+struct MemRequest {
+  uint64_t id;
+  uint32_t addr;
+  uint32_t wdata;
+  uint32_t wmask;
+  bool     is_write;
+};
+
+// NOTE: one agent per cpu bus port. Requests are sampled on every posedge where reqValid is high
+// and answered in order, each with a one cycle respValid pulse.
+// The LSU keeps reqValid high after the request was taken, so it runs with depth 1: a request sampled
+// while another is in flight replaces it. The IFU sends one pulse per request and runs with
+// depth VCPU_BUS_DEPTH, its refills and prefetches keep up to that many requests in flight.
+struct MemAgent {
+  MemPort  port;
+  uint32_t depth;
+  MemRequest inflight[MEM_AGENT_MAX_INFLIGHT];
+  uint32_t head;
+  uint32_t count;
+  uint64_t next_id;
+  uint64_t tail_tick;     // response tick of the newest request in flight
+  uint64_t respond_tick;  // tick of the last response
+  uint64_t responses;
+};
+
+void mem_agent_reset(MemAgent* agent, MemPort port, uint32_t depth) {
+  *agent = {};
+  agent->port  = port;
+  agent->depth = depth;
+}
+
+// NOTE: returns the tick of the response, never before the responses of the older requests
+uint64_t mem_agent_push(MemAgent* agent, uint64_t tick, uint64_t wait_ticks, MemRequest* request) {
+  if (agent->count == agent->depth) {
+    agent->head = (agent->head + 1) % MEM_AGENT_MAX_INFLIGHT;
+    agent->count--;
+  }
+  uint64_t after = agent->count ? agent->tail_tick : agent->respond_tick;
+  uint64_t respond_tick = tick + wait_ticks;
+  if (respond_tick <= after && (agent->count || agent->responses)) {
+    respond_tick = after + 1;
+  }
+  request->id = agent->next_id++;
+  agent->inflight[(agent->head + agent->count) % MEM_AGENT_MAX_INFLIGHT] = *request;
+  agent->count++;
+  agent->tail_tick = respond_tick;
+  return respond_tick;
+}
+
+void mem_agent_shift(MemAgent* agent, uint64_t ticks) {
+  agent->tail_tick    += ticks;
+  agent->respond_tick += ticks;
+}
+
+// NOTE: false when the request was replaced before its response
+bool mem_agent_pop(MemAgent* agent, uint64_t tick, uint64_t id, MemRequest* request) {
+  if (!agent->count || agent->inflight[agent->head].id != id) return false;
+  *request = agent->inflight[agent->head];
+  agent->head = (agent->head + 1) % MEM_AGENT_MAX_INFLIGHT;
+  agent->count--;
+  agent->respond_tick = tick;
+  agent->responses++;
+  return true;
+}
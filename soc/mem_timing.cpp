@@ -0,0 +1,287 @@
+#include <cstdint>
+#include <random>
+#include "mem_map.h"
+
+// NOTE: timing models of the vcpu memory agent.
+// A delay is the number of cycles added on top of the 1 cycle response of the agent.
+enum MemTimingModel {
+  MemTiming_Random, // uniform in [delay_min, delay_max)
+  MemTiming_Region, // fixed latency per region of mem_map.h
+  MemTiming_Sdram,  // SDRAM bank/row model for MEM, fixed latency elsewhere
+  MemTiming_Flash,  // SPI flash command model for FLASH, fixed latency elsewhere
+  MemTiming_Soc,    // SDRAM for MEM, SPI flash for FLASH, fixed latency elsewhere
+  MemTiming_Replay, // latencies recorded from a vsoc run, soc after the request stream diverges
+};
+
+enum MemPort {
+  MemPort_Ifu,
+  MemPort_Lsu,
+};
+
+// NOTE: the devices with a busy time, shared by both ports
+enum MemDevice {
+  MemDevice_Sdram,
+  MemDevice_Flash,
+};
+
+// NOTE: AXI/APB crossbar between the cpu and any device
+#define BUS_DELAY            (2)
+
+#define REGION_FLASH_DELAY   (140)
+#define REGION_MEM_DELAY     (12)
+#define REGION_UART_DELAY    (4)
+#define REGION_OTHER_DELAY   (2)
+
+// NOTE: ysyxSoC sdram: 16-bit wide, 4 banks, 512 columns, word access is 2 bursts
+#define SDRAM_BANKS          (4)
+#define SDRAM_COL_BITS       (9)
+#define SDRAM_BANK_BITS      (2)
+#define SDRAM_BEATS          (2)
+#define SDRAM_CAS            (2)
+#define SDRAM_TRCD           (2)
+#define SDRAM_TRP            (2)
+#define SDRAM_TWR            (2)
+#define SDRAM_TRFC           (7)
+#define SDRAM_REFRESH_PERIOD (780)
+
+// NOTE: SPI master: 8 command bits, 24 address bits, 32 data bits, each SCK is SPI_SCK_DIV cycles
+#define SPI_CMD_BITS         (8)
+#define SPI_ADDR_BITS        (24)
+#define SPI_DATA_BITS        (32)
+#define SPI_SCK_DIV          (2)
+#define SPI_SETUP            (8)
+// NOTE: continuous read (xip-burst): the flash keeps streaming while the chip select stays low,
+// a read of the next word within SPI_XIP_HOLD cycles of the previous response skips the setup, command and address bits
+#define SPI_XIP_HOLD         (16)
+
+// NOTE: a latency record file is the "MLAT" magic followed by one record per bus request in order:
+//   varint (latency << 2 | port << 1 | is_write), varint zigzag(addr - previous addr of the port)
+// the latency is counted in cycles from the request to the response as seen right after the posedge,
+// which is exactly the delay the vcpu memory agent needs to reproduce the response cycle.
+#define MEM_RECORD_MAGIC "MLAT"
+
+struct MemRecord {
+  FILE*    file;
+  uint64_t requests;
+  uint32_t last_addr[2];
+  bool     is_diverged;
+  uint64_t diverged_at;
+};
+
+struct MemTiming {
+  MemTimingModel model;
+  uint64_t delay_min;
+  uint64_t delay_max;
+  MemRecord replay;
+
+  bool     is_row_open[SDRAM_BANKS];
+  uint32_t open_row[SDRAM_BANKS];
+  uint64_t next_refresh;
+
+  bool     is_xip_burst;
+  uint32_t flash_next_addr;
+  uint64_t flash_end;
+
+  uint64_t device_busy[2];
+};
+
+static const char* mem_timing_names[] = { "random", "region", "sdram", "flash", "soc", "replay" };
+static const char* mem_port_names[]   = { "ifu", "lsu" };
+
+bool mem_timing_parse(const char* name, MemTimingModel* model) {
+  // NOTE: replay is selected with 'replay <path>'
+  for (uint32_t i = 0; i < MemTiming_Replay; i++) {
+    if (strcmp(name, mem_timing_names[i]) == 0) {
+      *model = (MemTimingModel)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void mem_timing_reset(MemTiming* timing) {
+  for (uint32_t i = 0; i < SDRAM_BANKS; i++) {
+    timing->is_row_open[i] = false;
+    timing->open_row[i]    = 0;
+  }
+  timing->next_refresh    = SDRAM_REFRESH_PERIOD;
+  timing->flash_next_addr = 0;
+  timing->flash_end       = 0;
+  timing->device_busy[MemDevice_Sdram] = 0;
+  timing->device_busy[MemDevice_Flash] = 0;
+}
+
+uint64_t region_delay(uint32_t addr) {
+  if (addr >= FLASH_START && addr < FLASH_END) return REGION_FLASH_DELAY;
+  if (addr >= MEM_START   && addr < MEM_END)   return REGION_MEM_DELAY;
+  if (addr >= UART_START  && addr < UART_END)  return REGION_UART_DELAY;
+  return REGION_OTHER_DELAY;
+}
+
+uint64_t sdram_delay(MemTiming* timing, uint64_t cycle, uint32_t addr, bool is_write) {
+  uint64_t delay = BUS_DELAY;
+  if (cycle >= timing->next_refresh) {
+    // NOTE: auto refresh precharges all banks
+    delay += SDRAM_TRFC;
+    for (uint32_t i = 0; i < SDRAM_BANKS; i++) timing->is_row_open[i] = false;
+    while (timing->next_refresh <= cycle) timing->next_refresh += SDRAM_REFRESH_PERIOD;
+  }
+
+  uint32_t offset = addr - MEM_START;
+  uint32_t bank   = (offset >> (1 + SDRAM_COL_BITS)) & (SDRAM_BANKS - 1);
+  uint32_t row    =  offset >> (1 + SDRAM_COL_BITS + SDRAM_BANK_BITS);
+  if (!timing->is_row_open[bank]) {
+    delay += SDRAM_TRCD;
+  }
+  else if (timing->open_row[bank] != row) {
+    delay += SDRAM_TRP + SDRAM_TRCD;
+  }
+  timing->is_row_open[bank] = true;
+  timing->open_row[bank]    = row;
+
+  delay += is_write ? SDRAM_TWR : SDRAM_CAS;
+  delay += SDRAM_BEATS;
+  return delay;
+}
+
+uint64_t flash_delay(MemTiming* timing, uint64_t cycle, uint32_t addr) {
+  uint64_t delay = BUS_DELAY + SPI_SETUP + (SPI_CMD_BITS + SPI_ADDR_BITS + SPI_DATA_BITS) * SPI_SCK_DIV;
+  if (timing->is_xip_burst) {
+    if (addr == timing->flash_next_addr && cycle <= timing->flash_end + SPI_XIP_HOLD) {
+      delay = BUS_DELAY + SPI_DATA_BITS * SPI_SCK_DIV;
+    }
+    timing->flash_next_addr = (addr & ~3u) + 4;
+    timing->flash_end       = cycle + delay;
+  }
+  return delay;
+}
+
+static void put_varint(FILE* f, uint64_t x) {
+  while (x >= 0x80) {
+    fputc((x & 0x7f) | 0x80, f);
+    x >>= 7;
+  }
+  fputc(x, f);
+}
+
+static bool get_varint(FILE* f, uint64_t* x) {
+  *x = 0;
+  for (uint32_t shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(f);
+    if (c == EOF) return false;
+    *x |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+bool mem_record_open(MemRecord* record, const char* path, bool is_write) {
+  *record = {};
+  record->file = fopen(path, is_write ? "wb" : "rb");
+  if (!record->file) return false;
+  if (is_write) {
+    fwrite(MEM_RECORD_MAGIC, 1, 4, record->file);
+    return true;
+  }
+  char magic[4] = {};
+  if (fread(magic, 1, 4, record->file) != 4 || memcmp(magic, MEM_RECORD_MAGIC, 4) != 0) {
+    fclose(record->file);
+    record->file = NULL;
+    return false;
+  }
+  return true;
+}
+
+void mem_record_close(MemRecord* record) {
+  if (record->file) fclose(record->file);
+  record->file = NULL;
+}
+
+void mem_record_put(MemRecord* record, MemPort port, uint32_t addr, bool is_write, uint64_t latency) {
+  int64_t delta = (int64_t)addr - (int64_t)record->last_addr[port];
+  put_varint(record->file, latency << 2 | port << 1 | is_write);
+  put_varint(record->file, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+  record->last_addr[port] = addr;
+  record->requests++;
+}
+
+bool mem_record_get(MemRecord* record, MemPort* port, uint32_t* addr, bool* is_write, uint64_t* latency) {
+  uint64_t head = 0;
+  uint64_t zigzag = 0;
+  if (!get_varint(record->file, &head) || !get_varint(record->file, &zigzag)) return false;
+  *port      = (MemPort)((head >> 1) & 1);
+  *is_write  = head & 1;
+  *latency   = head >> 2;
+  int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  *addr = record->last_addr[*port] + (uint32_t)delta;
+  record->last_addr[*port] = *addr;
+  record->requests++;
+  return true;
+}
+
+uint64_t mem_timing_delay(MemTiming* timing, std::mt19937* gen, uint64_t cycle, MemPort port, uint32_t addr, bool is_write);
+
+uint64_t replay_delay(MemTiming* timing, std::mt19937* gen, uint64_t cycle, MemPort port, uint32_t addr, bool is_write) {
+  MemRecord* replay = &timing->replay;
+  if (!replay->is_diverged) {
+    MemPort  r_port     = MemPort_Ifu;
+    uint32_t r_addr     = 0;
+    bool     r_is_write = false;
+    uint64_t r_latency  = 0;
+    uint64_t request    = replay->requests;
+    if (!mem_record_get(replay, &r_port, &r_addr, &r_is_write, &r_latency)) {
+      printf("[WARNING] replay diverged at request #%lu: recording has ended, vcpu %s 0x%08x (%s)\n",
+             request, mem_port_names[port], addr, is_write ? "w" : "r");
+      replay->is_diverged = true;
+      replay->diverged_at = request;
+    }
+    else if (r_port != port || r_addr != addr || r_is_write != is_write) {
+      printf("[WARNING] replay diverged at request #%lu: vcpu %s 0x%08x (%s) vs recorded %s 0x%08x (%s)\n",
+             request,
+             mem_port_names[port],   addr,   is_write   ? "w" : "r",
+             mem_port_names[r_port], r_addr, r_is_write ? "w" : "r");
+      replay->is_diverged = true;
+      replay->diverged_at = request;
+    }
+    else {
+      return r_latency;
+    }
+  }
+  timing->model = MemTiming_Soc;
+  uint64_t delay = mem_timing_delay(timing, gen, cycle, port, addr, is_write);
+  timing->model = MemTiming_Replay;
+  return delay;
+}
+
+// NOTE: sdram and the SPI flash serve one request at a time, whichever port it comes from: a request sampled
+// while an older one of either port is served by the same device (the ifu refills and prefetches in flight,
+// a load meanwhile) starts when it ends, as the soc bridge serializes them
+uint64_t device_delay(MemTiming* timing, uint64_t cycle, uint32_t addr, bool is_write, MemDevice device) {
+  uint64_t busy  = timing->device_busy[device];
+  uint64_t start = cycle > busy ? cycle : busy;
+  uint64_t delay = device == MemDevice_Flash ? flash_delay(timing, start, addr) : sdram_delay(timing, start, addr, is_write);
+  timing->device_busy[device] = start + delay;
+  return start - cycle + delay;
+}
+
+uint64_t mem_timing_delay(MemTiming* timing, std::mt19937* gen, uint64_t cycle, MemPort port, uint32_t addr, bool is_write) {
+  bool is_flash = addr >= FLASH_START && addr < FLASH_END;
+  bool is_mem   = addr >= MEM_START   && addr < MEM_END;
+  switch (timing->model) {
+    case MemTiming_Random:
+      return random_range(gen, timing->delay_min, timing->delay_max);
+    case MemTiming_Region:
+      return region_delay(addr);
+    case MemTiming_Sdram:
+      return is_mem ? device_delay(timing, cycle, addr, is_write, MemDevice_Sdram) : region_delay(addr);
+    case MemTiming_Flash:
+      return is_flash ? device_delay(timing, cycle, addr, is_write, MemDevice_Flash) : region_delay(addr);
+    case MemTiming_Soc:
+      if (is_mem)   return device_delay(timing, cycle, addr, is_write, MemDevice_Sdram);
+      if (is_flash) return device_delay(timing, cycle, addr, is_write, MemDevice_Flash);
+      return region_delay(addr);
+    case MemTiming_Replay:
+      return replay_delay(timing, gen, cycle, port, addr, is_write);
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+// events of the mhpmcounter CSRs, mhpmcounter3 counts the event 0
+localparam PERF_IFU_WAIT          = 0;
+localparam PERF_LSU_WAIT          = 1;
+localparam PERF_LOAD              = 2;
+localparam PERF_STORE             = 3;
+localparam PERF_SYSTEM            = 4;
+localparam PERF_CALC              = 5;
+localparam PERF_JUMP              = 6;
+localparam PERF_BRANCH            = 7;
+localparam PERF_BRANCH_TAKEN      = 8;
+localparam PERF_ICACHE_HIT        = 9;
+localparam PERF_ICACHE_MISS       = 10;
+localparam PERF_ICACHE_REFILL     = 11;
+localparam PERF_BRANCH_MISPREDICT = 12; // pipelined core only
+localparam PERF_BTB_HIT           = 13; // pipelined core only
+localparam PERF_DCACHE_HIT        = 14; // DCACHE builds only
+localparam PERF_DCACHE_MISS       = 15; // DCACHE builds only
+localparam PERF_DCACHE_WRITEBACK  = 16; // DCACHE builds only
+localparam PERF_PREFETCH_USEFUL   = 17;
+localparam PERF_PREFETCH_USELESS  = 18;
+localparam PERF_FUSED             = 19; // multicycle core only
+localparam PERF_EXU_END           = 8; // events 0-8 come from the exu
+localparam PERF_EVENTS_END        = 19;
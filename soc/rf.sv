@@ -14,7 +14,12 @@ module rf (
 /* verilator lint_on UNUSEDPARAM */
   localparam REG_NUM = 16;
 
+  // NOTE: the idle skip of the vcpu built with IDLE_SKIP=1 writes the registers
+`ifdef IDLE_SKIP
+  logic [REG_W_END:0] regs [0:REG_NUM-1] /* verilator public_flat_rw @(posedge clock) */;
+`else
   logic [REG_W_END:0] regs [0:REG_NUM-1];
+`endif
   integer i;
 
   always_ff @(posedge clock or posedge reset) begin
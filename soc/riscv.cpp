@@ -13,6 +13,10 @@
 #define OPCODE_CALC_IMM     (0b0010011)
 #define OPCODE_CALC_REG     (0b0110011)
 #define OPCODE_SYSTEM       (0b1110011)
+#define OPCODE_MULDIV       (0b10110011) // NOTE: not an opcode, OPCODE_CALC_REG with FUNCT7_MULDIV in random_instruction
+#define OPCODE_COMPRESSED   (0b100000000) // NOTE: not an opcode, a 16-bit instruction in random_instruction
+
+#define C_NOP (0x0001)
 
 #define ERROR_NOT_IMPLEMENTED (1010)
 #define ERROR_INVALID_RANGE   (2020)
@@ -44,11 +48,25 @@
 #define FUNCT3_OR   (0b110)
 #define FUNCT3_AND  (0b111)
 
+#define FUNCT7_MULDIV (0b0000001)
+#define FUNCT3_MUL    (0b000)
+#define FUNCT3_MULH   (0b001)
+#define FUNCT3_MULHSU (0b010)
+#define FUNCT3_MULHU  (0b011)
+#define FUNCT3_DIV    (0b100)
+#define FUNCT3_DIVU   (0b101)
+#define FUNCT3_REM    (0b110)
+#define FUNCT3_REMU   (0b111)
+
 #define REG_SP (2)
 #define REG_T0 (5)
 #define REG_T1 (6)
 #define REG_T2 (7)
 #define REG_A0 (10)
+#define REG_A1 (11)
+#define REG_A2 (12)
+#define REG_A3 (13)
+#define REG_T3 (28)
 
 #define  InstFlag_Jump   (1 << 0)
 #define  InstFlag_Branch (1 << 1)
@@ -56,6 +74,8 @@
 #define  InstFlag_Store  (1 << 3)
 #define  InstFlag_Calc   (1 << 4)
 #define  InstFlag_System (1 << 5)
+#define  InstFlag_MulDiv (1 << 6)
+#define  InstFlag_Compressed (1 << 7)
 
 int32_t sra32(uint32_t u, unsigned shift) {
   assert(shift < 32);
@@ -90,7 +110,7 @@ uint32_t take_bits_range(uint32_t bits, uint32_t from, uint32_t to) {
 }
 
 uint32_t r_type(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
-  uint32_t inst = (funct7 << 24) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+  uint32_t inst = (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
   return inst;
 }
 
@@ -290,10 +310,42 @@ uint32_t vor(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
 }
 
 uint32_t vand(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
-  uint32_t inst_u32 = (0b0100000 << 25) | (reg_src2 << 20) | (reg_src1 << 15) | (FUNCT3_AND << 12) | (reg_dest << 7) | OPCODE_CALC_REG;
+  uint32_t inst_u32 = (0b0000000 << 25) | (reg_src2 << 20) | (reg_src1 << 15) | (FUNCT3_AND << 12) | (reg_dest << 7) | OPCODE_CALC_REG;
   return inst_u32;
 }
 
+uint32_t mul(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_MUL, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t mulh(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_MULH, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t mulhsu(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_MULHSU, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t mulhu(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_MULHU, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t div(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_DIV, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t divu(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_DIVU, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t rem(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_REM, reg_dest, OPCODE_CALC_REG);
+}
+
+uint32_t remu(uint32_t reg_src2, uint32_t reg_src1, uint32_t reg_dest) {
+  return r_type(FUNCT7_MULDIV, reg_src2, reg_src1, FUNCT3_REMU, reg_dest, OPCODE_CALC_REG);
+}
+
 uint32_t ebreak() {
   uint32_t inst_u32 = 1u << 20 | OPCODE_SYSTEM;
   return inst_u32;
@@ -304,6 +356,111 @@ uint32_t li(uint32_t imm, uint32_t reg_dest) {
   return addi(imm, 0, reg_dest);
 }
 
+// NOTE: RV32C, a 16-bit instruction is the one whose two low bits are not 0b11;
+// the fetched 32 bits of a 16-bit instruction hold it in the low half
+bool is_rvc(uint32_t inst) {
+  return take_bits_range(inst, 0, 1) != 0b11;
+}
+
+uint32_t inst_size(uint32_t inst) {
+  return is_rvc(inst) ? 2 : 4;
+}
+
+static uint32_t sign_extend(uint32_t bits, uint32_t n) {
+  uint32_t sign = 1u << (n - 1);
+  return (bits ^ sign) - sign;
+}
+
+// NOTE: jal and b_type take the immediate fields as they are in the instruction, these place an offset in them
+static uint32_t jal_offset(uint32_t imm) {
+  return take_bit(imm, 20) << 19 | take_bits_range(imm, 1, 10) << 9 | take_bit(imm, 11) << 8 | take_bits_range(imm, 12, 19);
+}
+
+static uint32_t branch_offset(uint32_t imm) {
+  return take_bit(imm, 12) << 11 | take_bits_range(imm, 5, 10) << 5 | take_bits_range(imm, 1, 4) << 1 | take_bit(imm, 11);
+}
+
+// NOTE: the 32-bit instruction of a 16-bit one, like rvc.sv; 0 when it is illegal in RV32C
+// (the reserved and the float encodings, the zero immediates that must not be)
+uint32_t rvc_expand(uint16_t c) {
+  uint32_t op     = take_bits_range(c, 0, 1);
+  uint32_t funct3 = take_bits_range(c, 13, 15);
+  uint32_t rd     = take_bits_range(c, 7, 11);
+  uint32_t rs2    = take_bits_range(c, 2, 6);
+  uint32_t rd_c   = take_bits_range(c, 2, 4) + 8; // rd' and rs2'
+  uint32_t rs1_c  = take_bits_range(c, 7, 9) + 8; // rs1' and rd'
+  uint32_t bit12  = take_bit(c, 12);
+  uint32_t imm6   = sign_extend(bit12 << 5 | take_bits_range(c, 2, 6), 6);
+  uint32_t shamt  = bit12 << 5 | take_bits_range(c, 2, 6);
+  uint32_t j_imm  = sign_extend(bit12 << 11 | take_bit(c, 11) << 4 | take_bits_range(c, 9, 10) << 8 | take_bit(c, 8) << 10 |
+                                take_bit(c, 7) << 6 | take_bit(c, 6) << 7 | take_bits_range(c, 3, 5) << 1 | take_bit(c, 2) << 5, 12);
+  uint32_t b_imm  = sign_extend(bit12 << 8 | take_bits_range(c, 10, 11) << 3 | take_bits_range(c, 5, 6) << 6 |
+                                take_bits_range(c, 3, 4) << 1 | take_bit(c, 2) << 5, 9);
+  uint32_t w_imm  = take_bit(c, 5) << 6 | take_bits_range(c, 10, 12) << 3 | take_bit(c, 6) << 2;
+
+  switch (op << 3 | funct3) {
+    case 0b00'000: { // c.addi4spn
+      uint32_t imm = take_bits_range(c, 7, 10) << 6 | take_bits_range(c, 11, 12) << 4 | take_bit(c, 5) << 3 | take_bit(c, 6) << 2;
+      if (imm == 0) return 0;
+      return addi(imm, REG_SP, rd_c);
+    }
+    case 0b00'010: return lw(w_imm, rs1_c, rd_c);
+    case 0b00'110: return sw(w_imm, rd_c, rs1_c);
+    case 0b01'000: return addi(imm6, rd, rd); // c.nop when rd is 0
+    case 0b01'001: return jal(jal_offset(j_imm), 1);
+    case 0b01'010: return li(imm6, rd);
+    case 0b01'011: {
+      if (rd == REG_SP) { // c.addi16sp
+        uint32_t imm = sign_extend(bit12 << 9 | take_bits_range(c, 3, 4) << 7 | take_bit(c, 5) << 6 |
+                                   take_bit(c, 2) << 5 | take_bit(c, 6) << 4, 10);
+        if (imm == 0) return 0;
+        return addi(imm, REG_SP, REG_SP);
+      }
+      if (imm6 == 0) return 0;
+      return lui(imm6 & 0xfffff, rd);
+    }
+    case 0b01'100: {
+      switch (take_bits_range(c, 10, 11)) {
+        case 0b00: return bit12 ? 0 : srli(shamt, rs1_c, rs1_c);
+        case 0b01: return bit12 ? 0 : srai(shamt, rs1_c, rs1_c);
+        case 0b10: return andi(imm6, rs1_c, rs1_c);
+      }
+      if (bit12) return 0;
+      switch (take_bits_range(c, 5, 6)) {
+        case 0b00: return sub (rd_c, rs1_c, rs1_c);
+        case 0b01: return vxor(rd_c, rs1_c, rs1_c);
+        case 0b10: return vor (rd_c, rs1_c, rs1_c);
+        default:   return vand(rd_c, rs1_c, rs1_c);
+      }
+    }
+    case 0b01'101: return jal(jal_offset(j_imm), 0);
+    case 0b01'110: return b_type(branch_offset(b_imm), 0, rs1_c, FUNCT3_BEQ, OPCODE_BRANCH);
+    case 0b01'111: return b_type(branch_offset(b_imm), 0, rs1_c, FUNCT3_BNE, OPCODE_BRANCH);
+    case 0b10'000: return bit12 ? 0 : slli(shamt, rd, rd);
+    case 0b10'010: {
+      if (rd == 0) return 0;
+      uint32_t imm = take_bits_range(c, 2, 3) << 6 | bit12 << 5 | take_bits_range(c, 4, 6) << 2;
+      return lw(imm, REG_SP, rd);
+    }
+    case 0b10'100: {
+      if (!bit12 && rs2 == 0) return rd == 0 ? 0 : jalr(0, rd, 0); // c.jr
+      if (!bit12)             return add(rs2, 0, rd);               // c.mv
+      if (rs2 == 0)           return rd == 0 ? ebreak() : jalr(0, rd, 1);
+      return add(rs2, rd, rd);
+    }
+    case 0b10'110: {
+      uint32_t imm = take_bits_range(c, 7, 8) << 6 | take_bits_range(c, 9, 12) << 2;
+      return sw(imm, rs2, REG_SP);
+    }
+  }
+  return 0;
+}
+
+// NOTE: the 32-bit form of a fetched instruction
+uint32_t inst_expand(uint32_t inst) {
+  return is_rvc(inst) ? rvc_expand(inst & 0xffff) : inst;
+}
+
 
 struct InstInfo {
   uint8_t reg_dest;
@@ -349,6 +506,15 @@ InstInfo inst_info(uint32_t inst) {
 }
 
 void print_instruction(uint32_t inst) {
+  if (is_rvc(inst)) {
+    uint32_t expanded = rvc_expand(inst & 0xffff);
+    if (expanded == 0) {
+      printf("GM WARNING: not implemented:0x%04x\n", inst & 0xffff);
+      return;
+    }
+    printf("c.");
+    inst = expanded;
+  }
   InstInfo info = inst_info(inst);
   switch (info.opcode) {
     case OPCODE_LUI: {
@@ -411,7 +577,17 @@ void print_instruction(uint32_t inst) {
       printf(" imm=%5i rs1=%2u rd=%2u\n", info.i_imm, info.reg_src1, info.reg_dest);
     } break;
     case OPCODE_CALC_REG: {
-      switch (info.funct3) {
+      if (info.funct7 == FUNCT7_MULDIV) switch (info.funct3) {
+        case FUNCT3_MUL:    printf("mul   "); break;
+        case FUNCT3_MULH:   printf("mulh  "); break;
+        case FUNCT3_MULHSU: printf("mulhsu"); break;
+        case FUNCT3_MULHU:  printf("mulhu "); break;
+        case FUNCT3_DIV:    printf("div   "); break;
+        case FUNCT3_DIVU:   printf("divu  "); break;
+        case FUNCT3_REM:    printf("rem   "); break;
+        case FUNCT3_REMU:   printf("remu  "); break;
+      }
+      else switch (info.funct3) {
         case FUNCT3_ADD:   {
           if (info.funct7 == 0)  printf("add");
           else printf("sub");
@@ -431,7 +607,17 @@ void print_instruction(uint32_t inst) {
       printf("  rs2=%u\t rs1=%u\t rd=%u\n", info.reg_src2, info.reg_src1, info.reg_dest);
     } break;
     case OPCODE_SYSTEM: {
-      printf("ebreak\n");
+      uint32_t csr = info.i_imm & 0xfff;
+      switch (info.funct3) {
+        case 0b000: printf("ebreak\n"); break;
+        case 0b001: printf("csrrw  csr=0x%03x rs1=%2u rd=%2u\n", csr, info.reg_src1, info.reg_dest); break;
+        case 0b010: printf("csrrs  csr=0x%03x rs1=%2u rd=%2u\n", csr, info.reg_src1, info.reg_dest); break;
+        case 0b011: printf("csrrc  csr=0x%03x rs1=%2u rd=%2u\n", csr, info.reg_src1, info.reg_dest); break;
+        case 0b101: printf("csrrwi csr=0x%03x imm=%2u rd=%2u\n", csr, info.reg_src1, info.reg_dest); break;
+        case 0b110: printf("csrrsi csr=0x%03x imm=%2u rd=%2u\n", csr, info.reg_src1, info.reg_dest); break;
+        case 0b111: printf("csrrci csr=0x%03x imm=%2u rd=%2u\n", csr, info.reg_src1, info.reg_dest); break;
+        default: goto not_implemented;
+      }
     } break;
 
     default: { // NOT IMPLEMENTED
@@ -453,6 +639,40 @@ uint32_t random_bits(std::mt19937* gen, uint32_t n) {
   return dist(*gen);
 }
 
+// NOTE: a random 16-bit instruction of the classes in flags, any class when flags has none; its registers
+// are the ones of RV32E. c.nop when none comes in a few tries
+uint32_t random_compressed(std::mt19937* gen, uint32_t flags) {
+  uint32_t all_classes = InstFlag_Jump | InstFlag_Branch | InstFlag_Load | InstFlag_Store | InstFlag_Calc;
+  uint32_t classes = flags & all_classes;
+  if (classes == 0) classes = all_classes;
+  for (uint32_t i = 0; i < 64; i++) {
+    uint32_t c = random_bits(gen, 16);
+    if (!is_rvc(c)) continue;
+    uint32_t inst = rvc_expand(c);
+    if (inst == 0 || inst == ebreak()) continue;
+    InstInfo info = inst_info(inst);
+    uint32_t inst_class = InstFlag_Calc;
+    bool is_rd  = true;
+    bool is_rs1 = true;
+    bool is_rs2 = false;
+    switch (info.opcode) {
+      case OPCODE_JAL:      inst_class = InstFlag_Jump;   is_rs1 = false;               break;
+      case OPCODE_JALR:     inst_class = InstFlag_Jump;                                 break;
+      case OPCODE_BRANCH:   inst_class = InstFlag_Branch; is_rd  = false; is_rs2 = true; break;
+      case OPCODE_LOAD:     inst_class = InstFlag_Load;                                 break;
+      case OPCODE_STORE:    inst_class = InstFlag_Store;  is_rd  = false; is_rs2 = true; break;
+      case OPCODE_LUI:      inst_class = InstFlag_Calc;   is_rs1 = false;               break;
+      case OPCODE_CALC_REG: inst_class = InstFlag_Calc;   is_rs2 = true;                break;
+    }
+    if (!(classes & inst_class)) continue;
+    if (is_rd  && info.reg_dest >= N_REGS) continue;
+    if (is_rs1 && info.reg_src1 >= N_REGS) continue;
+    if (is_rs2 && info.reg_src2 >= N_REGS) continue;
+    return c;
+  }
+  return C_NOP;
+}
+
 uint32_t random_instruction(std::mt19937* gen, uint32_t flags) {
   uint32_t opcodes[128] = {};
   uint32_t opcode_count = 0;
@@ -478,6 +698,12 @@ uint32_t random_instruction(std::mt19937* gen, uint32_t flags) {
   if (flags & InstFlag_System) {
     for (uint32_t i = 0; i < 1; i++) opcodes[opcode_count++] = OPCODE_SYSTEM;
   }
+  if (flags & InstFlag_MulDiv) {
+    for (uint32_t i = 0; i < 4; i++) opcodes[opcode_count++] = OPCODE_MULDIV;
+  }
+  if (flags & InstFlag_Compressed) {
+    for (uint32_t i = 0; i < 20; i++) opcodes[opcode_count++] = OPCODE_COMPRESSED;
+  }
 
   uint32_t opcode_id = random_range(gen, 0, opcode_count);
   uint32_t opcode = opcodes[opcode_id];
@@ -539,14 +765,24 @@ uint32_t random_instruction(std::mt19937* gen, uint32_t flags) {
     case OPCODE_CALC_REG: {
       uint32_t rs2 = random_bits(gen, 4);
       uint32_t rs1 = random_bits(gen, 4);
-      uint32_t funct7 = random_bits(gen, 1) << 6;
+      uint32_t funct7 = random_bits(gen, 1) << 5;
       uint32_t funct3 = random_bits(gen, 3);
       uint32_t rd  = random_bits(gen, 4);
       inst = r_type(funct7, rs2, rs1, funct3, rd, opcode);
     } break;
+    case OPCODE_MULDIV: {
+      uint32_t rs2 = random_bits(gen, 4);
+      uint32_t rs1 = random_bits(gen, 4);
+      uint32_t funct3 = random_bits(gen, 3);
+      uint32_t rd  = random_bits(gen, 4);
+      inst = r_type(FUNCT7_MULDIV, rs2, rs1, funct3, rd, OPCODE_CALC_REG);
+    } break;
     case OPCODE_SYSTEM: {
       inst = ebreak();
     } break;
+    case OPCODE_COMPRESSED: {
+      inst = random_compressed(gen, flags);
+    } break;
   }
   return inst;
 }
@@ -0,0 +1,124 @@
+// NOTE: RV32C, the 32-bit instruction of a 16-bit one (its two low bits are not 2'b11), like rvc_expand in riscv.cpp.
+// expanded is 0 when the instruction is illegal in RV32C: the reserved and the float encodings,
+// the zero immediates that must not be. The decoder finds no instruction type for 0.
+module rvc (
+  input  logic [15:0] inst,
+  output logic [31:0] expanded);
+
+  localparam OPCODE_LUI       = 7'b0110111;
+  localparam OPCODE_JAL       = 7'b1101111;
+  localparam OPCODE_JALR      = 7'b1100111;
+  localparam OPCODE_BRANCH    = 7'b1100011;
+  localparam OPCODE_LOAD      = 7'b0000011;
+  localparam OPCODE_STORE     = 7'b0100011;
+  localparam OPCODE_CALC_IMM  = 7'b0010011;
+  localparam OPCODE_CALC_REG  = 7'b0110011;
+
+  localparam REG_ZERO = 5'd0;
+  localparam REG_RA   = 5'd1;
+  localparam REG_SP   = 5'd2;
+  localparam EBREAK   = 32'h0010_0073;
+
+  logic [4:0]  rd;
+  logic [4:0]  rs2;
+  logic [4:0]  rd_c;  // rd' and rs2'
+  logic [4:0]  rs1_c; // rs1' and rd'
+  logic [5:0]  shamt;
+  logic [11:0] imm6;
+  logic [11:0] w_imm;
+  logic [11:0] addi4spn_imm;
+  logic [11:0] addi16sp_imm;
+  logic [11:0] lwsp_imm;
+  logic [11:0] swsp_imm;
+  logic [19:0] lui_imm;
+  logic [20:0] j_imm;
+  logic [12:0] b_imm;
+  logic [31:0] jal;
+  logic [31:0] branch;
+
+  assign rd    = inst[11:7];
+  assign rs2   = inst[6:2];
+  assign rd_c  = {2'b01, inst[4:2]};
+  assign rs1_c = {2'b01, inst[9:7]};
+  assign shamt = {inst[12], inst[6:2]};
+
+  assign imm6         = {{7{inst[12]}}, inst[6:2]};
+  assign w_imm        = {5'b0, inst[5], inst[12:10], inst[6], 2'b00};
+  assign addi4spn_imm = {2'b0, inst[10:7], inst[12:11], inst[5], inst[6], 2'b00};
+  assign addi16sp_imm = {{3{inst[12]}}, inst[4:3], inst[5], inst[2], inst[6], 4'b0};
+  assign lwsp_imm     = {4'b0, inst[3:2], inst[12], inst[6:4], 2'b00};
+  assign swsp_imm     = {4'b0, inst[8:7], inst[12:9], 2'b00};
+  assign lui_imm      = {{15{inst[12]}}, inst[6:2]};
+  assign j_imm        = {{10{inst[12]}}, inst[8], inst[10:9], inst[6], inst[7], inst[2], inst[11], inst[5:3], 1'b0};
+  assign b_imm        = {{5{inst[12]}}, inst[6:5], inst[2], inst[11:10], inst[4:3], 1'b0};
+
+  // NOTE: c.jal and c.j differ in rd, c.beqz and c.bnez in funct3 (inst[13])
+  assign jal    = {j_imm[20], j_imm[10:1], j_imm[11], j_imm[19:12], inst[15] ? REG_ZERO : REG_RA, OPCODE_JAL};
+  assign branch = {b_imm[12], b_imm[10:5], REG_ZERO, rs1_c, 2'b00, inst[13], b_imm[4:1], b_imm[11], OPCODE_BRANCH};
+
+  always_comb begin
+    expanded = 32'b0;
+    case ({inst[1:0], inst[15:13]})
+      5'b00_000: begin // c.addi4spn
+        if (addi4spn_imm != 0) expanded = {addi4spn_imm, REG_SP, 3'b000, rd_c, OPCODE_CALC_IMM};
+      end
+      5'b00_010: expanded = {w_imm, rs1_c, 3'b010, rd_c, OPCODE_LOAD};                    // c.lw
+      5'b00_110: expanded = {w_imm[11:5], rd_c, rs1_c, 3'b010, w_imm[4:0], OPCODE_STORE}; // c.sw
+      5'b01_000: expanded = {imm6, rd, 3'b000, rd, OPCODE_CALC_IMM};                      // c.addi, c.nop
+      5'b01_001: expanded = jal;                                                          // c.jal
+      5'b01_010: expanded = {imm6, REG_ZERO, 3'b000, rd, OPCODE_CALC_IMM};                // c.li
+      5'b01_011: begin
+        if (rd == REG_SP) begin // c.addi16sp
+          if (addi16sp_imm != 0) expanded = {addi16sp_imm, REG_SP, 3'b000, REG_SP, OPCODE_CALC_IMM};
+        end
+        else if (lui_imm != 0) begin // c.lui
+          expanded = {lui_imm, rd, OPCODE_LUI};
+        end
+      end
+      5'b01_100: begin
+        case (inst[11:10])
+          2'b00: if (!inst[12]) expanded = {7'b0000000, shamt[4:0], rs1_c, 3'b101, rs1_c, OPCODE_CALC_IMM}; // c.srli
+          2'b01: if (!inst[12]) expanded = {7'b0100000, shamt[4:0], rs1_c, 3'b101, rs1_c, OPCODE_CALC_IMM}; // c.srai
+          2'b10: expanded = {imm6, rs1_c, 3'b111, rs1_c, OPCODE_CALC_IMM};                                  // c.andi
+          default: begin
+            if (!inst[12]) begin
+              case (inst[6:5])
+                2'b00:   expanded = {7'b0100000, rd_c, rs1_c, 3'b000, rs1_c, OPCODE_CALC_REG}; // c.sub
+                2'b01:   expanded = {7'b0000000, rd_c, rs1_c, 3'b100, rs1_c, OPCODE_CALC_REG}; // c.xor
+                2'b10:   expanded = {7'b0000000, rd_c, rs1_c, 3'b110, rs1_c, OPCODE_CALC_REG}; // c.or
+                default: expanded = {7'b0000000, rd_c, rs1_c, 3'b111, rs1_c, OPCODE_CALC_REG}; // c.and
+              endcase
+            end
+          end
+        endcase
+      end
+      5'b01_101: expanded = jal;    // c.j
+      5'b01_110: expanded = branch; // c.beqz
+      5'b01_111: expanded = branch; // c.bnez
+      5'b10_000: begin // c.slli
+        if (!inst[12]) expanded = {7'b0000000, shamt[4:0], rd, 3'b001, rd, OPCODE_CALC_IMM};
+      end
+      5'b10_010: begin // c.lwsp
+        if (rd != REG_ZERO) expanded = {lwsp_imm, REG_SP, 3'b010, rd, OPCODE_LOAD};
+      end
+      5'b10_100: begin
+        if (!inst[12] && rs2 == REG_ZERO) begin // c.jr
+          if (rd != REG_ZERO) expanded = {12'b0, rd, 3'b000, REG_ZERO, OPCODE_JALR};
+        end
+        else if (!inst[12]) begin // c.mv
+          expanded = {7'b0000000, rs2, REG_ZERO, 3'b000, rd, OPCODE_CALC_REG};
+        end
+        else if (rs2 == REG_ZERO) begin // c.ebreak, c.jalr
+          expanded = rd == REG_ZERO ? EBREAK : {12'b0, rd, 3'b000, REG_RA, OPCODE_JALR};
+        end
+        else begin // c.add
+          expanded = {7'b0000000, rs2, rd, 3'b000, rd, OPCODE_CALC_REG};
+        end
+      end
+      5'b10_110: expanded = {swsp_imm[11:5], rs2, REG_SP, 3'b010, swsp_imm[4:0], OPCODE_STORE}; // c.swsp
+      default: begin
+      end
+    endcase
+  end
+
+endmodule
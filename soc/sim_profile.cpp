@@ -0,0 +1,121 @@
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <time.h>
+#if defined(SIM_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// NOTE: wall time and call counts of the testbench phases, only in the SIM_PROFILE=1 build: the hooks
+// sit on the hot path (every eval, trace dump, flash read and gold step), elsewhere they compile to nothing.
+// The time is read with rdtsc and converted to ns with the rate measured over the whole run.
+// The DPI callbacks run inside eval(), their time is also part of the eval of their model.
+enum ProfPhase {
+  Prof_VsocEval,
+  Prof_VcpuEval,
+  Prof_Gold,
+  Prof_Agents,
+  Prof_Compare,
+  Prof_Trace,
+  Prof_Log,
+  Prof_DpiFlash,
+  Prof_Count,
+};
+
+static const char* prof_phase_names[] = {
+  "vsoc eval",
+  "vcpu eval",
+  "gold",
+  "vcpu agents",
+  "compare",
+  "trace dump",
+  "log",
+  "dpi flash_read",
+};
+
+struct ProfStat {
+  uint64_t calls;
+  uint64_t ticks;
+};
+
+struct SimProfile {
+  uint64_t start_ns;
+  uint64_t start_ticks;
+  ProfStat stats[Prof_Count];
+};
+
+static SimProfile sim_profile;
+
+static inline uint64_t prof_now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+}
+
+static inline uint64_t prof_ticks() {
+#if defined(SIM_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+  return __rdtsc();
+#else
+  return prof_now_ns();
+#endif
+}
+
+#ifdef SIM_PROFILE
+static inline uint64_t prof_begin() {
+  return prof_ticks();
+}
+
+static inline void prof_end(ProfPhase phase, uint64_t begin) {
+  sim_profile.stats[phase].calls++;
+  sim_profile.stats[phase].ticks += prof_ticks() - begin;
+}
+#else
+static inline uint64_t prof_begin() {
+  return 0;
+}
+
+static inline void prof_end(ProfPhase, uint64_t) {
+}
+#endif
+
+void prof_init() {
+  sim_profile = {};
+  sim_profile.start_ns    = prof_now_ns();
+  sim_profile.start_ticks = prof_ticks();
+}
+
+// NOTE: printf of the per tick/fetch/request logs, accounted as Prof_Log
+void prof_printf(const char* fmt, ...) {
+  uint64_t begin = prof_begin();
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+  prof_end(Prof_Log, begin);
+}
+
+void prof_print() {
+#ifdef SIM_PROFILE
+  uint64_t wall_ns    = prof_now_ns() - sim_profile.start_ns;
+  uint64_t wall_ticks = prof_ticks() - sim_profile.start_ticks;
+  double   ns_per_tick = wall_ticks ? (double)wall_ns / wall_ticks : 1.0;
+  double   wall = wall_ns / 1e9;
+  double   phases_ns = 0;
+  printf("[INFO] testbench profile: %.3f s\n", wall);
+  printf("  %-24s %14s %12s %7s %10s\n", "phase", "calls", "time, s", "%", "ns/call");
+  for (uint32_t i = 0; i < Prof_Count; i++) {
+    ProfStat* stat = &sim_profile.stats[i];
+    if (!stat->calls) continue;
+    double ns = stat->ticks * ns_per_tick;
+    if (i < Prof_DpiFlash) phases_ns += ns;
+    printf("  %-24s %14lu %12.3f %7.2f %10.1f\n",
+           prof_phase_names[i],
+           stat->calls,
+           ns / 1e9,
+           wall > 0 ? 100.0 * ns / 1e9 / wall : 0.0,
+           ns / stat->calls);
+  }
+  double other = wall - phases_ns / 1e9;
+  printf("  %-24s %14s %12.3f %7.2f\n", "other", "", other, wall > 0 ? 100.0 * other / wall : 0.0);
+#endif
+}
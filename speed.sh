@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# Simulated kHz of the vsoc/vcpu models per verilator thread count on microbench and cpu-tests
+set -uo pipefail
+
+usage() {
+  echo "Usage:"
+  echo "  $0 vsoc|vcpu [threads...]   # default threads: 1 2 4 \$(nproc)"
+  echo "  HIER=1 $0 vsoc [threads...] # with the hierarchical peripherals of soc/hier.vlt"
+}
+
+CPU="${1:-vsoc}"
+shift || true
+
+case "$CPU" in
+  vsoc)
+    THREADS_VAR=THREADS
+    ;;
+  vcpu)
+    THREADS_VAR=VCPU_THREADS
+    ;;
+  *)
+    usage
+    exit 1
+    ;;
+esac
+
+if [[ $# -gt 0 ]]; then
+  THREAD_COUNTS=("$@")
+else
+  THREAD_COUNTS=(1 2 4 "$(nproc)")
+fi
+
+LOG="$(mktemp)"
+trap 'rm -f "$LOG"' EXIT
+
+# NOTE: kHz over all the runs of a log: sum of cycles / sum of seconds
+khz() {
+  grep -o "\[INFO\] $CPU speed: .*" "$LOG" |
+    awk '{ gsub(/\(/, ""); cycles += $6; seconds += $9 } END { if (seconds > 0) printf "%.1f", cycles / seconds / 1000; else printf "-" }'
+}
+
+printf "%-8s %16s %16s\n" "threads" "microbench kHz" "cpu-tests kHz"
+for n in "${THREAD_COUNTS[@]}"; do
+  export "$THREADS_VAR"="$n"
+  ./bench.sh "$CPU" > "$LOG" 2>&1
+  BENCH_KHZ="$(khz)"
+  ./cpu_test.sh "$CPU" > "$LOG" 2>&1
+  TESTS_KHZ="$(khz)"
+  printf "%-8s %16s %16s\n" "$n" "$BENCH_KHZ" "$TESTS_KHZ"
+done